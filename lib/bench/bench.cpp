@@ -0,0 +1,284 @@
+// Benchmarks of the core kernels. Prints one JSON document with the
+// throughput and per-operation time percentiles of every benchmark;
+// compare.py checks it against baseline.json.
+//
+//     ./bench [--filter substring] [--quick] [--out file]
+
+#include "gf4.h"
+#include "series.h"
+#include "codes.h"
+#include "search.h"
+#include <chrono>
+#include <random>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <functional>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <cstdio>
+
+using namespace cppcodes;
+
+// Keeps results alive so the compiler cannot drop the work.
+static volatile uint64_t sink;
+
+struct Result{
+    std::string name;
+    size_t samples;
+    size_t ops;
+    double ops_per_sec;
+    double p50_ns;
+    double p90_ns;
+    double p99_ns;
+};
+
+struct Options{
+    std::string filter;
+    bool quick;
+    std::string out;
+    Options(): filter(), quick(false), out() {};
+};
+
+class Bench{
+    public:
+        Options options;
+        std::vector<Result> results;
+
+        Bench(const Options& o): options(o), results() {};
+
+        // Runs `op` (which does `batch` operations and returns a value to
+        // sink) for `samples` timed samples after one warm-up sample.
+        void run(const std::string& name, size_t batch, size_t samples, const std::function<uint64_t()>& op){
+            if (!options.filter.empty() && name.find(options.filter) == std::string::npos)
+                return;
+            if (options.quick)
+                samples = std::max<size_t>(3, samples / 5);
+            sink = sink + op();
+            std::vector<double> times;
+            double total = 0;
+            for (size_t s = 0; s < samples; ++s){
+                auto start = std::chrono::steady_clock::now();
+                sink = sink + op();
+                double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+                total += ns;
+                times.push_back(ns / batch);
+            }
+            std::sort(times.begin(), times.end());
+            auto pct = [&](double p){ return times[std::min(times.size() - 1, (size_t)(p * times.size()))]; };
+            Result r;
+            r.name = name;
+            r.samples = samples;
+            r.ops = samples * batch;
+            r.ops_per_sec = r.ops / (total * 1e-9);
+            r.p50_ns = pct(0.5);
+            r.p90_ns = pct(0.9);
+            r.p99_ns = pct(0.99);
+            results.push_back(r);
+            std::cerr << name << ": " << r.p50_ns << " ns/op" << std::endl;
+        }
+
+        std::string json() const {
+            std::ostringstream s;
+            s << "{\n  \"benchmarks\": [\n";
+            for (size_t i = 0; i < results.size(); ++i){
+                auto& r = results[i];
+                s << "    {\"name\": \"" << r.name << "\", \"samples\": " << r.samples
+                  << ", \"ops\": " << r.ops << ", \"ops_per_sec\": " << r.ops_per_sec
+                  << ", \"p50_ns\": " << r.p50_ns << ", \"p90_ns\": " << r.p90_ns
+                  << ", \"p99_ns\": " << r.p99_ns << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+            }
+            s << "  ]\n}\n";
+            return s.str();
+        }
+};
+
+static Series randomSeries(std::mt19937& random, size_t size){
+    std::vector<gf4> coeffs(size);
+    for (auto& c: coeffs)
+        c = gf4((char)(random() % 4));
+    coeffs[0] = gf4((char)1);
+    coeffs[size - 1] = gf4((char)(1 + random() % 3));
+    return Series(coeffs);
+}
+
+// Code of k rows whose degrees add up to `memory`, split as evenly as
+// possible, with constant coefficient 1 in the first column.
+static Code randomCode(std::mt19937& random, size_t n, size_t k, size_t memory){
+    std::vector<Series> generators;
+    for (size_t i = 0; i < k; ++i){
+        size_t degree = memory / k + (i < memory % k ? 1 : 0);
+        for (size_t j = 0; j < n; ++j)
+            generators.push_back(randomSeries(random, degree + 1));
+    }
+    return Code(generators, n, k);
+}
+
+static void gf4Benchmarks(Bench& bench){
+    std::mt19937 random(1);
+    std::vector<gf4> a(4096), b(4096);
+    for (size_t i = 0; i < a.size(); ++i){
+        a[i] = gf4((char)(random() % 4));
+        b[i] = gf4((char)(random() % 4));
+    }
+    bench.run("gf4/add", a.size(), 200, [&](){
+        uint64_t s = 0;
+        for (size_t i = 0; i < a.size(); ++i)
+            s += (a[i] + b[i]).value;
+        return s;
+    });
+    bench.run("gf4/mul", a.size(), 200, [&](){
+        uint64_t s = 0;
+        for (size_t i = 0; i < a.size(); ++i)
+            s += (a[i] * b[i]).value;
+        return s;
+    });
+    bench.run("gf4/conj", a.size(), 200, [&](){
+        uint64_t s = 0;
+        for (size_t i = 0; i < a.size(); ++i)
+            s += a[i].conj().value;
+        return s;
+    });
+}
+
+static void seriesBenchmarks(Bench& bench){
+    for (size_t size: {8, 32, 64}){
+        std::mt19937 random(2 + size);
+        std::vector<Series> a, b;
+        for (size_t i = 0; i < 256; ++i){
+            a.push_back(randomSeries(random, size));
+            b.push_back(randomSeries(random, size));
+        }
+        std::string suffix = "/" + std::to_string(size);
+        bench.run("series/mul" + suffix, a.size(), 100, [&](){
+            uint64_t s = 0;
+            for (size_t i = 0; i < a.size(); ++i)
+                s += (a[i] * b[i]).coeffs.size();
+            return s;
+        });
+        bench.run("series/add" + suffix, a.size(), 100, [&](){
+            uint64_t s = 0;
+            for (size_t i = 0; i < a.size(); ++i)
+                s += (a[i] + b[i]).coeffs.size();
+            return s;
+        });
+        bench.run("series/inverse" + suffix, a.size(), 100, [&](){
+            uint64_t s = 0;
+            for (size_t i = 0; i < a.size(); ++i)
+                s += a[i].inverse().coeffs.size();
+            return s;
+        });
+        bench.run("series/conj" + suffix, a.size(), 100, [&](){
+            uint64_t s = 0;
+            for (size_t i = 0; i < a.size(); ++i)
+                s += a[i].conj().coeffs.size();
+            return s;
+        });
+        bench.run("series/strip" + suffix, a.size(), 100, [&](){
+            uint64_t s = 0;
+            for (size_t i = 0; i < a.size(); ++i){
+                Series x(a[i].coeffs, 0);
+                x.coeffs.insert(x.coeffs.begin(), 4, gf4());
+                x.zero_shift = 4;
+                x.coeffs.resize(x.coeffs.size() + 4);
+                s += x.strip().coeffs.size();
+            }
+            return s;
+        });
+    }
+}
+
+static void codeBenchmarks(Bench& bench){
+    for (size_t n: {2, 3, 4})
+        for (size_t k = 1; k < n && k <= 2; ++k)
+            for (size_t memory: {2, 4, 6}){
+                std::mt19937 random(3 + 100 * n + 10 * k + memory);
+                std::vector<Code> codes;
+                for (size_t i = 0; i < 16; ++i)
+                    codes.push_back(randomCode(random, n, k, memory));
+                std::string name = "code/minDistance/n" + std::to_string(n) + "_k" + std::to_string(k) + "_m" + std::to_string(memory);
+                bench.run(name, codes.size(), 30, [&](){
+                    uint64_t s = 0;
+                    for (auto& c: codes)
+                        s += c.minDistance();
+                    return s;
+                });
+            }
+
+    for (size_t n: {2, 3, 4})
+        for (size_t degree: {2, 4, 6}){
+            std::mt19937 random(4 + 100 * n + degree);
+            std::vector<Code> codes, orthogonal;
+            // codes without an orthogonal code of full rank are skipped
+            while (codes.size() < 16){
+                Code c = randomCode(random, n, 1, degree);
+                try{
+                    orthogonal.push_back(c.findOrthogonal());
+                } catch (const std::logic_error&){
+                    continue;
+                }
+                codes.push_back(c);
+            }
+            std::string suffix = "/n" + std::to_string(n) + "_d" + std::to_string(degree);
+            bench.run("code/findOrthogonal" + suffix, codes.size(), 30, [&](){
+                uint64_t s = 0;
+                for (auto& c: codes)
+                    s += c.findOrthogonal().generators.size();
+                return s;
+            });
+            bench.run("code/isOrthogonal" + suffix, codes.size(), 100, [&](){
+                uint64_t s = 0;
+                for (size_t i = 0; i < codes.size(); ++i)
+                    s += codes[i].isOrthogonal(orthogonal[i]);
+                return s;
+            });
+        }
+}
+
+static void searchBenchmarks(Bench& bench){
+    struct Case{ size_t n, degree; xlong min_distance; bool canonical; };
+    for (auto c: {Case{3, 4, 0, false}, Case{4, 3, 0, false}, Case{3, 5, 0, false},
+                  Case{3, 4, 6, false}, Case{4, 4, 0, true}}){
+        std::string name = "search/n" + std::to_string(c.n) + "_d" + std::to_string(c.degree);
+        if (c.min_distance > 0)
+            name += "_md" + std::to_string(c.min_distance);
+        if (c.canonical)
+            name += "_canonical";
+        bench.run(name, 1, 5, [&](){
+            SearchSelfOrthogonal s(c.n, c.degree);
+            s.setMinDistance(c.min_distance);
+            s.setCanonical(c.canonical);
+            return (uint64_t)s.find().size();
+        });
+    }
+}
+
+int main(int argc, char** argv){
+    Options options;
+    for (int i = 1; i < argc; ++i){
+        std::string a = argv[i];
+        if (a == "--quick")
+            options.quick = true;
+        else if (a == "--filter" && i + 1 < argc)
+            options.filter = argv[++i];
+        else if (a == "--out" && i + 1 < argc)
+            options.out = argv[++i];
+        else {
+            std::cerr << "usage: " << argv[0] << " [--filter substring] [--quick] [--out file]" << std::endl;
+            return 2;
+        }
+    }
+
+    Bench bench(options);
+    gf4Benchmarks(bench);
+    seriesBenchmarks(bench);
+    codeBenchmarks(bench);
+    searchBenchmarks(bench);
+
+    if (options.out.empty())
+        std::cout << bench.json();
+    else
+        std::ofstream(options.out) << bench.json();
+    return 0;
+}
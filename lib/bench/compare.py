@@ -0,0 +1,54 @@
+"""Compares a benchmark run with a baseline.
+
+    python3 compare.py baseline.json result.json [--threshold 0.25]
+
+Prints the median time per operation of both runs for every benchmark
+and exits with status 1 if any benchmark is slower than the baseline by
+more than the threshold (a fraction, 0.25 by default).
+"""
+import argparse
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        return {b['name']: b for b in json.load(f)['benchmarks']}
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('baseline')
+    parser.add_argument('result')
+    parser.add_argument('--threshold', type=float, default=0.25)
+    args = parser.parse_args()
+
+    baseline, result = load(args.baseline), load(args.result)
+    regressions = []
+    print('%-40s %14s %14s %8s' % ('benchmark', 'baseline ns', 'result ns', 'ratio'))
+    for name, r in result.items():
+        if name not in baseline:
+            print('%-40s %14s %14.1f %8s' % (name, '-', r['p50_ns'], 'new'))
+            continue
+        b = baseline[name]
+        ratio = r['p50_ns'] / b['p50_ns'] if b['p50_ns'] > 0 else float('inf')
+        mark = ''
+        if ratio > 1 + args.threshold:
+            regressions.append(name)
+            mark = ' slower'
+        elif ratio < 1 / (1 + args.threshold):
+            mark = ' faster'
+        print('%-40s %14.1f %14.1f %8.2f%s' % (name, b['p50_ns'], r['p50_ns'], ratio, mark))
+    for name in baseline:
+        if name not in result:
+            print('%-40s %14.1f %14s %8s' % (name, baseline[name]['p50_ns'], '-', 'missing'))
+
+    if regressions:
+        print('%d benchmark(s) slower than the baseline by more than %d%%: %s'
+              % (len(regressions), args.threshold * 100, ', '.join(regressions)))
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,49 @@
+#include "batch.h"
+#include "parallel.h"
+
+using namespace cppcodes;
+
+// codes handled by one task of the thread pool
+static const size_t BATCH_CHUNK = 64;
+
+// Distance of code.findOrthogonal(), false if there is no such code.
+static bool orthogonalDistance(Code& code, xlong& distance){
+    Code other(code.n);
+    try{
+        other = code.findOrthogonal();
+    } catch (const std::logic_error&){
+        return false;
+    }
+    distance = other.minDistance();
+    return true;
+}
+
+void cppcodes::minDistanceBatch(const uint8_t* data, size_t count, size_t generators, size_t length,
+                                size_t k, bool orthogonal, size_t threads, xlong* out){
+    if (k == 0 || generators % k != 0)
+        throw std::invalid_argument("Number of generators is not a multiple of k");
+    if (length == 0)
+        throw std::invalid_argument("Generators have no coefficients");
+    for (size_t i = 0; i < count * generators * length; ++i)
+        if (data[i] >= GF4_SIZE)
+            throw std::invalid_argument("unrecognized value");
+
+    size_t n = generators / k;
+    size_t chunks = (count + BATCH_CHUNK - 1) / BATCH_CHUNK;
+    parallelFor(chunks, workerCount(threads, chunks), [&](size_t chunk, size_t){
+        for (size_t c = chunk * BATCH_CHUNK; c < count && c < (chunk + 1) * BATCH_CHUNK; ++c){
+            Code code(n, k);
+            for (size_t g = 0; g < generators; ++g){
+                Series s(length, 0);
+                const uint8_t* coeffs = data + (c * generators + g) * length;
+                for (size_t i = 0; i < length; ++i)
+                    s.coeffs[i].value = coeffs[i];
+                code.generators.push_back(s);
+            }
+            if (!orthogonal)
+                out[c] = code.minDistance();
+            else if (!orthogonalDistance(code, out[c]))
+                out[c] = 0;
+        }
+    });
+}
@@ -0,0 +1,20 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "codes.h"
+#include <cstdint>
+
+namespace cppcodes{
+
+// Minimal distances of `count` codes given as coefficient values 0..3:
+// coefficient i of generator g of code c is data[(c * generators + g) * length + i],
+// generators are laid out as in Code with n = generators / k. With
+// `orthogonal` the distance of findOrthogonal() is computed instead, 0
+// for a code that has no orthogonal code of full rank.
+// Results go to out[0..count), using `threads` threads (0 for all cores).
+void minDistanceBatch(const uint8_t* data, size_t count, size_t generators, size_t length,
+                      size_t k, bool orthogonal, size_t threads, xlong* out);
+
+}
+
+#endif
@@ -1,17 +1,137 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/operators.h>
 #include <pybind11/stl.h>
+#include <pybind11/numpy.h>
 #include <string>
 #include <vector>
 #include "gf4.h"
 #include "series.h"
 #include "codes.h"
 #include "search.h"
+#include "batch.h"
+#include "serialize.h"
+#include <fstream>
 
 namespace py = pybind11;
 
 using namespace cppcodes;
 
+// Python iterator over the results of SearchSelfOrthogonal::find,
+// yielding lists of at most `batch` codes.
+struct SearchIterator{
+    SearchSelfOrthogonal* search;
+    SearchCursor cursor;
+    size_t batch;
+    xlong min_distance;
+    bool canonical;
+    SearchIterator(SearchSelfOrthogonal* search_, size_t batch_, xlong min_distance_, bool canonical_)
+    : search(search_), cursor(), batch(batch_), min_distance(min_distance_), canonical(canonical_) {};
+
+    std::vector<Code> next(){
+        std::vector<Code> codes;
+        {
+            py::gil_scoped_release release;
+            SearchSelfOrthogonal::Session session(*search, min_distance, canonical);
+            search->next(cursor, codes, batch);
+        }
+        if (codes.empty())
+            throw py::stop_iteration();
+        return codes;
+    }
+};
+
+// Bytes of a one-dimensional contiguous buffer, such as bytes or a
+// uint8 NumPy array.
+static std::pair<const uint8_t*, size_t> bufferBytes(py::buffer b){
+    py::buffer_info info = b.request();
+    if (info.ndim != 1 || info.strides[0] != info.itemsize)
+        throw std::invalid_argument("Expected a contiguous one-dimensional buffer");
+    return std::make_pair((const uint8_t*)info.ptr, (size_t)(info.size * info.itemsize));
+}
+
+static py::object distanceArray(const std::vector<xlong>& distances, bool stored){
+    if (!stored)
+        return py::none();
+    return py::array_t<xlong>(distances.size(), distances.data());
+}
+
+// Writes codes to a file as they come, see CodeWriter.
+struct CodeFileWriter{
+    std::ofstream out;
+    CodeWriter writer;
+    CodeFileWriter(const std::string& path, bool distances)
+    : out(path, std::ios::binary | std::ios::trunc), writer(out, distances) {
+        if (!out)
+            throw std::runtime_error("Cannot write " + path);
+    };
+
+    void write(const std::vector<Code>& codes, py::object distances){
+        std::vector<xlong> d;
+        if (!distances.is_none())
+            d = distances.cast<std::vector<xlong>>();
+        if (!distances.is_none() && d.size() != codes.size())
+            throw std::invalid_argument("Expected one distance per code");
+        py::gil_scoped_release release;
+        for (size_t i = 0; i < codes.size(); ++i)
+            writer.write(codes[i], d.empty() ? 0 : d[i]);
+    }
+
+    void close(){
+        out.close();
+        if (!out)
+            throw std::runtime_error("Cannot write codes");
+    }
+};
+
+// Reads a file written by CodeFileWriter or PackedCodes.save() in
+// batches of (codes, distances), distances being None if not stored.
+struct CodeFileReader{
+    std::ifstream in;
+    CodeReader reader;
+    size_t batch;
+    CodeFileReader(const std::string& path, size_t batch_)
+    : in(path, std::ios::binary), reader(opened(in, path)), batch(batch_) {};
+
+    static std::istream& opened(std::ifstream& in, const std::string& path){
+        if (!in)
+            throw std::runtime_error("Cannot open " + path);
+        return in;
+    }
+
+    py::tuple read(size_t count){
+        std::vector<Code> codes;
+        std::vector<xlong> distances;
+        {
+            py::gil_scoped_release release;
+            Code code(0);
+            xlong distance;
+            while (codes.size() < count && reader.next(code, distance)){
+                codes.push_back(std::move(code));
+                distances.push_back(distance);
+            }
+        }
+        return py::make_tuple(codes, distanceArray(distances, reader.hasDistances()));
+    }
+
+    py::tuple next(){
+        py::tuple result = read(batch);
+        if (py::len(result[0]) == 0)
+            throw py::stop_iteration();
+        return result;
+    }
+};
+
+// Runs fn(*args, **kwargs) on a thread of a process-wide
+// concurrent.futures.ThreadPoolExecutor and returns its Future. The
+// functions it runs release the GIL, so their calls overlap.
+static py::object submit(py::object fn, py::tuple args, py::dict kwargs){
+    // leaked, so that it is not released after the interpreter is gone;
+    // concurrent.futures joins the pool at exit
+    static py::object* executor = new py::object(
+        py::module_::import("concurrent.futures").attr("ThreadPoolExecutor")());
+    return executor->attr("submit")(fn, *args, **kwargs);
+}
+
 PYBIND11_MODULE(codeslib, m){
     m.doc() = "codeslib";
 
@@ -46,6 +166,12 @@ PYBIND11_MODULE(codeslib, m){
         .def("conj", &Series::conj)
     ;
 
+    py::enum_<DistanceOrder>(m, "DistanceOrder")
+        .value("BELOW", DISTANCE_BELOW)
+        .value("EQUAL", DISTANCE_EQUAL)
+        .value("ABOVE", DISTANCE_ABOVE)
+    ;
+
     py::class_<Code>(m, "Code")
         .def(py::init<size_t, size_t>())
         .def(py::init<size_t>())
@@ -56,22 +182,181 @@ PYBIND11_MODULE(codeslib, m){
         .def("add", &Code::add)
         .def("remove", &Code::remove)
         .def("validate", &Code::validate)
-        .def("minDistance", &Code::minDistance)
-        .def("isSelfOrthogonal", &Code::isSelfOrthogonal)
+        .def("minDistance", &Code::minDistance, py::arg("bound") = INFTY, py::call_guard<py::gil_scoped_release>())
+        .def("hasDistanceAtLeast", &Code::hasDistanceAtLeast, py::arg("d"), py::call_guard<py::gil_scoped_release>())
+        .def("compareDistance", &Code::compareDistance, py::arg("target"), py::call_guard<py::gil_scoped_release>())
+        .def("distanceSpectrum", &Code::distanceSpectrum, py::arg("max_weight"), py::call_guard<py::gil_scoped_release>())
+        .def("isSelfOrthogonal", &Code::isSelfOrthogonal, py::call_guard<py::gil_scoped_release>())
         .def_readonly("n", &Code::n)
         .def_readonly("k", &Code::k)
         .def_readwrite("generators", &Code::generators)
         .def("__repr__", &Code::toString)
-        .def("findOrthogonal", &Code::findOrthogonal)
-        .def("isOrthogonal", &Code::isOrthogonal)
+        .def("findOrthogonal", &Code::findOrthogonal, py::call_guard<py::gil_scoped_release>())
+        .def("isOrthogonal", &Code::isOrthogonal, py::arg("other"), py::call_guard<py::gil_scoped_release>())
+        .def("rank", &Code::rank, py::call_guard<py::gil_scoped_release>())
         .def("weight", &Code::weight)
+        .def("canonical", &Code::canonical, py::call_guard<py::gil_scoped_release>())
+        .def("minDistanceAsync", [](py::object self, py::args args, py::kwargs kwargs){
+                return submit(self.attr("minDistance"), args, kwargs);
+            })
+        .def("findOrthogonalAsync", [](py::object self){
+                return submit(self.attr("findOrthogonal"), py::tuple(), py::dict());
+            })
+        .def("isOrthogonalAsync", [](py::object self, py::object other){
+                return submit(self.attr("isOrthogonal"), py::make_tuple(other), py::dict());
+            }, py::arg("other"))
+        .def("serialize", [](const Code& c){
+                PackedCodes p;
+                p.add(c);
+                return py::bytes((const char*)p.data.data(), p.data.size());
+            })
+        .def_static("deserialize", [](py::buffer data){
+                auto bytes = bufferBytes(data);
+                std::vector<Code> codes = deserializeCodes(bytes.first, bytes.second);
+                if (codes.size() != 1)
+                    throw std::invalid_argument("Expected exactly one code");
+                return codes[0];
+            }, py::arg("data"))
     ;
 
+    py::class_<PackedCodes>(m, "PackedCodes", py::buffer_protocol())
+        .def(py::init([](py::buffer data){
+                auto bytes = bufferBytes(data);
+                return PackedCodes(bytes.first, bytes.second);
+            }), py::arg("data"))
+        .def_buffer([](PackedCodes& p) -> py::buffer_info {
+                return py::buffer_info(p.data.data(), sizeof(uint8_t), py::format_descriptor<uint8_t>::format(),
+                                       1, {p.data.size()}, {sizeof(uint8_t)});
+            })
+        .def("__len__", &PackedCodes::size)
+        .def_property_readonly("has_distances", &PackedCodes::hasDistances)
+        .def("codes", [](const PackedCodes& p){ return p.codes(); }, py::call_guard<py::gil_scoped_release>())
+        .def("distances", [](const PackedCodes& p){
+                std::vector<xlong> distances;
+                p.codes(&distances);
+                return distanceArray(distances, p.hasDistances());
+            })
+        .def("save", &PackedCodes::save, py::arg("path"), py::call_guard<py::gil_scoped_release>())
+        .def_static("load", &PackedCodes::load, py::arg("path"), py::call_guard<py::gil_scoped_release>())
+    ;
+
+    m.def("serializeCodes", [](const std::vector<Code>& codes, py::object distances){
+            if (distances.is_none())
+                return serializeCodes(codes);
+            std::vector<xlong> d = distances.cast<std::vector<xlong>>();
+            return serializeCodes(codes, &d);
+        }, py::arg("codes"), py::arg("distances") = py::none());
+    m.def("deserializeCodes", [](py::buffer data){
+            auto bytes = bufferBytes(data);
+            return deserializeCodes(bytes.first, bytes.second);
+        }, py::arg("data"));
+
+    py::class_<CodeFileWriter>(m, "CodeWriter")
+        .def(py::init<const std::string&, bool>(), py::arg("path"), py::arg("distances") = false)
+        .def("write", &CodeFileWriter::write, py::arg("codes"), py::arg("distances") = py::none())
+        .def("close", &CodeFileWriter::close)
+        .def_property_readonly("count", [](const CodeFileWriter& w){ return w.writer.count(); })
+        .def("__enter__", [](py::object self){ return self; })
+        .def("__exit__", [](CodeFileWriter& w, py::object, py::object, py::object){ w.close(); })
+    ;
+
+    py::class_<CodeFileReader>(m, "CodeReader")
+        .def(py::init<const std::string&, size_t>(), py::arg("path"), py::arg("batch") = 4096)
+        .def_property_readonly("has_distances", [](const CodeFileReader& r){ return r.reader.hasDistances(); })
+        .def("read", &CodeFileReader::read, py::arg("count"))
+        .def("__iter__", [](py::object self){ return self; })
+        .def("__next__", &CodeFileReader::next)
+    ;
+
+    m.def("minDistances", [](py::array_t<uint8_t, py::array::c_style | py::array::forcecast> codes,
+                             size_t k, bool orthogonal, size_t threads){
+            if (codes.ndim() != 3)
+                throw std::invalid_argument("Expected an array of shape (codes, generators, coefficients)");
+            size_t count = codes.shape(0), generators = codes.shape(1), length = codes.shape(2);
+            py::array_t<xlong> distances(count);
+            const uint8_t* data = codes.data();
+            xlong* out = distances.mutable_data();
+            {
+                py::gil_scoped_release release;
+                minDistanceBatch(data, count, generators, length, k, orthogonal, threads, out);
+            }
+            return distances;
+        }, py::arg("codes"), py::arg("k") = 1, py::arg("orthogonal") = false, py::arg("threads") = 0);
+    m.def("minDistancesAsync", [](py::args args, py::kwargs kwargs){
+            return submit(py::module_::import("codeslib").attr("minDistances"), args, kwargs);
+        });
+
+    m.def("stats", [](){ return GlobalStats::instance().snapshot().toMap(); });
+    m.def("resetStats", [](){ GlobalStats::instance().reset(); });
+    m.def("enableStats", &enableStats, py::arg("on") = true);
+    m.def("statsEnabled", &statsEnabled);
+
+    m.def("buildRggTable", [](size_t degree, const std::string& path){
+            RggTable::build(degree).save(path);
+        }, py::arg("degree"), py::arg("path"), py::call_guard<py::gil_scoped_release>());
+
+    py::register_exception<SearchCancelled>(m, "SearchCancelled", PyExc_RuntimeError);
+
     py::class_<SearchSelfOrthogonal>(m, "SearchSelfOrthogonal")
-        .def(py::init<size_t, size_t>())
+        .def(py::init<size_t, size_t, size_t>(), py::arg("n"), py::arg("degree"), py::arg("k") = 1)
         .def_property_readonly("k", &SearchSelfOrthogonal::getK)
         .def_property_readonly("n", &SearchSelfOrthogonal::getN)
         .def_property_readonly("degree", &SearchSelfOrthogonal::getDegree)
-        .def("find", &SearchSelfOrthogonal::find)
+        .def_property("table_path", &SearchSelfOrthogonal::getTablePath, &SearchSelfOrthogonal::setTablePath)
+        .def_property("join_memory", &SearchSelfOrthogonal::getJoinMemory, &SearchSelfOrthogonal::setJoinMemory)
+        .def_property_readonly("stats", [](SearchSelfOrthogonal& s){ return s.getStats().toMap(); })
+        .def("resetStats", &SearchSelfOrthogonal::resetStats)
+        .def("bucketSizes", &SearchSelfOrthogonal::bucketSizes, py::call_guard<py::gil_scoped_release>())
+        .def("progress", [](SearchSelfOrthogonal& s){
+                SearchProgress p = s.getProgress();
+                py::dict d;
+                d["nodes"] = p.nodes;
+                d["codes"] = p.codes;
+                d["tasks_done"] = p.tasks_done;
+                d["tasks"] = p.tasks;
+                d["running"] = p.running;
+                return d;
+            })
+        .def("cancel", &SearchSelfOrthogonal::cancel)
+        .def("find", [](SearchSelfOrthogonal& s, size_t threads, xlong min_distance, bool canonical,
+                        const std::string& checkpoint, double checkpoint_seconds, size_t checkpoint_nodes,
+                        size_t shard_index, size_t shard_count, const std::string& shard_path){
+                SearchSelfOrthogonal::Session session(s, min_distance, canonical);
+                if (shard_count != 1 || !shard_path.empty()){
+                    if (!checkpoint.empty())
+                        throw std::invalid_argument("Sharded search cannot be checkpointed");
+                    if (shard_path.empty())
+                        return s.findShard(shard_index, shard_count, threads);
+                    return s.findShard(shard_index, shard_count, threads, shard_path);
+                }
+                if (checkpoint.empty())
+                    return s.find(threads);
+                if (threads != 1)
+                    throw std::invalid_argument("Checkpointed search runs on one thread");
+                return s.find(checkpoint, checkpoint_seconds, checkpoint_nodes);
+            }, py::arg("threads") = 1, py::arg("min_distance") = 0, py::arg("canonical") = false,
+            py::arg("checkpoint") = "", py::arg("checkpoint_seconds") = 60.0, py::arg("checkpoint_nodes") = 0,
+            py::arg("shard_index") = 0, py::arg("shard_count") = 1, py::arg("shard_path") = "",
+            py::call_guard<py::gil_scoped_release>())
+        .def("findAsync", [](py::object self, py::args args, py::kwargs kwargs){
+                return submit(self.attr("find"), args, kwargs);
+            })
+        .def("mergeShards", [](SearchSelfOrthogonal& s, const std::vector<std::string>& paths,
+                               xlong min_distance, bool canonical){
+                SearchSelfOrthogonal::Session session(s, min_distance, canonical);
+                return s.mergeShards(paths);
+            }, py::arg("paths"), py::arg("min_distance") = 0, py::arg("canonical") = false,
+            py::call_guard<py::gil_scoped_release>())
+        .def("iterate", [](SearchSelfOrthogonal& s, size_t batch, xlong min_distance, bool canonical){
+                if (canonical && s.getK() != 1)
+                    throw std::invalid_argument("Canonical search needs k = 1");
+                return SearchIterator(&s, batch, min_distance, canonical);
+            }, py::arg("batch") = 1024, py::arg("min_distance") = 0, py::arg("canonical") = false,
+            py::keep_alive<0, 1>())
+    ;
+
+    py::class_<SearchIterator>(m, "SearchIterator")
+        .def("__iter__", [](SearchIterator& it) -> SearchIterator& { return it; })
+        .def("__next__", &SearchIterator::next)
     ;
 }
\ No newline at end of file
@@ -0,0 +1,77 @@
+#include "branch.h"
+#include <cstring>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CPPCODES_X86 1
+#endif
+
+using namespace cppcodes;
+
+static void portableWeights(uint64_t out, const uint64_t* inputs, size_t count, uint8_t* weights){
+    for (size_t u = 0; u < count; ++u)
+        weights[u] = (uint8_t)symbolWeight(out ^ inputs[u]);
+}
+
+#if CPPCODES_X86
+// No popcount of 64-bit lanes below AVX-512 VPOPCNTDQ: bytes are counted
+// a nibble at a time through a shuffle table and summed per lane.
+__attribute__((target("avx2")))
+static void avx2Weights(uint64_t out, const uint64_t* inputs, size_t count, uint8_t* weights){
+    const __m256i o = _mm256_set1_epi64x((long long)out);
+    const __m256i low = _mm256_set1_epi64x(0x5555555555555555LL);
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                           0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    alignas(32) uint64_t sums[4];
+    for (size_t u = 0; u < count; u += 4){
+        __m256i x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(inputs + u)), o);
+        x = _mm256_and_si256(_mm256_or_si256(x, _mm256_srli_epi64(x, 1)), low);
+        __m256i bytes = _mm256_add_epi8(_mm256_shuffle_epi8(table, _mm256_and_si256(x, nibble)),
+                                        _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi64(x, 4), nibble)));
+        _mm256_store_si256((__m256i*)sums, _mm256_sad_epu8(bytes, _mm256_setzero_si256()));
+        for (size_t i = 0; i < 4; ++i)
+            weights[u + i] = (uint8_t)sums[i];
+    }
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void avx512Weights(uint64_t out, const uint64_t* inputs, size_t count, uint8_t* weights){
+    const __m512i o = _mm512_set1_epi64((long long)out);
+    const __m512i low = _mm512_set1_epi64(0x5555555555555555LL);
+    const __m512i nibble = _mm512_set1_epi8(0x0f);
+    const __m512i table = _mm512_broadcast_i32x4(_mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4));
+    size_t u = 0;
+    for (; u + 8 <= count; u += 8){
+        __m512i x = _mm512_xor_si512(_mm512_loadu_si512((const void*)(inputs + u)), o);
+        x = _mm512_and_si512(_mm512_or_si512(x, _mm512_srli_epi64(x, 1)), low);
+        __m512i bytes = _mm512_add_epi8(_mm512_shuffle_epi8(table, _mm512_and_si512(x, nibble)),
+                                        _mm512_shuffle_epi8(table, _mm512_and_si512(_mm512_srli_epi64(x, 4), nibble)));
+        _mm_storel_epi64((__m128i*)(weights + u), _mm512_cvtepi64_epi8(_mm512_sad_epu8(bytes, _mm512_setzero_si512())));
+    }
+    if (u < count)
+        avx2Weights(out, inputs + u, count - u, weights + u);
+}
+#endif
+
+BranchWeights cppcodes::branchWeights(const char* name){
+    if (std::strcmp(name, "portable") == 0)
+        return &portableWeights;
+#if CPPCODES_X86
+    __builtin_cpu_init();
+    if (std::strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2"))
+        return &avx2Weights;
+    if (std::strcmp(name, "avx512") == 0 && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+        return &avx512Weights;
+#endif
+    return nullptr;
+}
+
+BranchWeights cppcodes::branchWeights(){
+    static const BranchWeights best = [](){
+        BranchWeights f = branchWeights("avx512");
+        if (!f)
+            f = branchWeights("avx2");
+        return f ? f : &portableWeights;
+    }();
+    return best;
+}
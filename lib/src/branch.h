@@ -0,0 +1,30 @@
+#ifndef BRANCH_H
+#define BRANCH_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace cppcodes{
+
+// Branch outputs pack n output symbols into a word, two bits per symbol
+// as in Trellis; the weight of a branch is its number of nonzero symbols.
+inline uint32_t symbolWeight(uint64_t x){
+    return (uint32_t)__builtin_popcountll((x | (x >> 1)) & 0x5555555555555555ULL);
+}
+
+// weights[u] = symbolWeight(out ^ inputs[u]) for u < count: the weights
+// of every branch leaving a state whose lags give `out`. count is a
+// multiple of 4, as 4^k inputs are.
+typedef void (*BranchWeights)(uint64_t out, const uint64_t* inputs, size_t count, uint8_t* weights);
+
+// The fastest kernel this CPU runs: AVX-512BW, AVX2 or portable code,
+// chosen on the first call.
+BranchWeights branchWeights();
+
+// Kernel by name ("avx512", "avx2" or "portable"), nullptr if the CPU or
+// the compiler lacks it.
+BranchWeights branchWeights(const char* name);
+
+}
+
+#endif
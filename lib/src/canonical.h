@@ -0,0 +1,138 @@
+#ifndef CANONICAL_H
+#define CANONICAL_H
+
+#include "packed.h"
+#include <vector>
+#include <algorithm>
+
+namespace cppcodes{
+
+// Equivalence of k = 1 codes: columns may be permuted, shifted in time
+// and multiplied by a unit each, and the whole code may be conjugated
+// or reversed in time. None of these change the distance or
+// self-orthogonality. A column is normalised by shifting and scaling it
+// to constant coefficient 1, which leaves conjugation and reversal,
+// applied to all columns at once, as the transforms left to compare.
+
+// Columns compare by autocorrelation first, then by coefficients from
+// degree 0 up, so columns sharing an Rgg bucket are adjacent.
+struct ColumnKey{
+    PackedSeries autocorrelation;
+    uint64_t coeffs;
+
+    bool operator<(const ColumnKey& o) const {
+        if (autocorrelation != o.autocorrelation)
+            return autocorrelation < o.autocorrelation;
+        return coeffs < o.coeffs;
+    };
+
+    bool operator==(const ColumnKey& o) const {
+        return autocorrelation == o.autocorrelation && coeffs == o.coeffs;
+    };
+};
+
+inline PackedSeries scaleColumn(const PackedSeries& g, short c){
+    return g * PackedSeries(c & 1, c >> 1, 1, 0);
+}
+
+// Shifts the lowest nonzero coefficient of g to degree 0 and scales it
+// to 1, keeping `length` coefficients.
+inline PackedSeries normalizeColumn(const PackedSeries& g, size_t length){
+    uint64_t nz = g.lo | g.hi;
+    if (nz == 0)
+        return PackedSeries(0, 0, length, 0);
+    size_t t = __builtin_ctzll(nz);
+    PackedSeries s(g.lo >> t, g.hi >> t, length, 0);
+    s = scaleColumn(s, s.at(0).conj().value);
+    s.size = length;
+    return s;
+}
+
+// Reverses g within its own degree, then normalises it.
+inline PackedSeries reverseColumn(const PackedSeries& g, size_t length){
+    uint64_t nz = g.lo | g.hi;
+    if (nz == 0)
+        return g;
+    size_t top = 64 - __builtin_clzll(nz);
+    PackedSeries r(reverseBits(g.lo) >> (64 - top), reverseBits(g.hi) >> (64 - top), top, 0);
+    return normalizeColumn(r, length);
+}
+
+inline ColumnKey columnKey(const PackedSeries& g, size_t length){
+    ColumnKey key;
+    key.autocorrelation = g.inverse().conj() * g;
+    key.coeffs = 0;
+    for (size_t i = 0; i < length; ++i)
+        key.coeffs = (key.coeffs << 2) | g.at(i).value;
+    return key;
+}
+
+// Transform t of a normalised column: bit 0 conjugates, bit 1 reverses
+// the code in time.
+inline PackedSeries transformColumn(const PackedSeries& g, size_t length, int t){
+    PackedSeries h = g;
+    if (t & 1)
+        h = h.conj();
+    if (t & 2)
+        h = reverseColumn(h, length);
+    return h;
+}
+
+// Sorted column keys of normalised `columns` after transform t.
+inline void transformedKeys(const std::vector<PackedSeries>& columns, size_t length, int t, std::vector<ColumnKey>& keys){
+    keys.clear();
+    for (auto& g: columns)
+        keys.push_back(columnKey(transformColumn(g, length, t), length));
+    std::sort(keys.begin(), keys.end());
+}
+
+// Order of sorted column keys: the autocorrelations alone decide first,
+// which lets a search rule out a transform from its Rgg keys.
+inline bool keysLess(const std::vector<ColumnKey>& a, const std::vector<ColumnKey>& b){
+    for (size_t i = 0; i < a.size() && i < b.size(); ++i)
+        if (a[i].autocorrelation != b[i].autocorrelation)
+            return a[i].autocorrelation < b[i].autocorrelation;
+    return a < b;
+}
+
+// Transform whose sorted column keys are the smallest, the first one on ties.
+inline int canonicalTransform(const std::vector<PackedSeries>& columns, size_t length){
+    std::vector<ColumnKey> best, keys;
+    transformedKeys(columns, length, 0, best);
+    int t_best = 0;
+    for (int t = 1; t < 4; ++t){
+        transformedKeys(columns, length, t, keys);
+        if (keysLess(keys, best)){
+            best.swap(keys);
+            t_best = t;
+        }
+    }
+    return t_best;
+}
+
+// True if normalised `columns` are already in canonical order and no
+// transform gives smaller column keys. `own` and `keys` are scratch
+// buffers, so a caller that keeps them does not allocate.
+inline bool isCanonical(const std::vector<PackedSeries>& columns, size_t length,
+                        std::vector<ColumnKey>& own, std::vector<ColumnKey>& keys){
+    own.clear();
+    for (auto& g: columns)
+        own.push_back(columnKey(g, length));
+    if (!std::is_sorted(own.begin(), own.end()))
+        return false;
+    for (int t = 1; t < 4; ++t){
+        transformedKeys(columns, length, t, keys);
+        if (keysLess(keys, own))
+            return false;
+    }
+    return true;
+}
+
+inline bool isCanonical(const std::vector<PackedSeries>& columns, size_t length){
+    std::vector<ColumnKey> own, keys;
+    return isCanonical(columns, length, own, keys);
+}
+
+}
+
+#endif
@@ -1,5 +1,12 @@
 #include "codes.h"
+#include "trellis.h"
+#include "fixed.h"
+#include "canonical.h"
+#include "matrix.h"
+#include "stats.h"
 #include <cstdlib>
+#include <algorithm>
+#include <functional>
 
 #define LOG(msg) \
     std::cerr << __FILE__ << "(" << __LINE__ << "): " << msg << std::endl 
@@ -97,12 +104,61 @@ bool Code::isSelfOrthogonal(){
 bool Code::isOrthogonal(Code& other){
     if (n != other.n)
         throw new std::logic_error("Codes have different n");
+    bool packed = true;
+    for (auto& g: generators)
+        packed = packed && g.zero_shift == 0 && 2 * g.coeffs.size() <= PACKED_CAPACITY;
+    for (auto& g: other.generators)
+        packed = packed && g.zero_shift == 0 && 2 * g.coeffs.size() <= PACKED_CAPACITY;
+    if (packed){
+        // Reversing every generator of a row of this code to the longest
+        // length in the row gives all products of the row the same zero
+        // shift, so they add up as plain words: row i is orthogonal to row
+        // j if the sum over columns m of the conjugate reversal of
+        // generator (i, m) times generator (j, m) is zero. Each generator
+        // is packed once and small codes keep the words on the stack.
+        const size_t STACK_GENERATORS = 32;
+        size_t count = generators.size() + other.generators.size();
+        uint64_t stack[2 * STACK_GENERATORS];
+        std::vector<uint64_t> heap(count > STACK_GENERATORS ? 2 * count : 0);
+        uint64_t* a = count > STACK_GENERATORS ? heap.data() : stack;
+        uint64_t* b = a + 2 * generators.size();
+        for (size_t i = 0; i < k; ++i){
+            size_t length = maxSize(i);
+            for (size_t m = 0; m < n; ++m){
+                PackedSeries p = generators[i * n + m].pack();
+                uint64_t lo = shiftRight(reverseBits(p.lo), 64 - length), hi = shiftRight(reverseBits(p.hi), 64 - length);
+                a[2 * (i * n + m)] = lo ^ hi;
+                a[2 * (i * n + m) + 1] = hi;
+            }
+        }
+        for (size_t j = 0; j < other.generators.size(); ++j){
+            PackedSeries p = other.generators[j].pack();
+            b[2 * j] = p.lo;
+            b[2 * j + 1] = p.hi;
+        }
+        for (size_t i = 0; i < k; ++i){
+            for (size_t j = 0; j < other.k; ++j){
+                uint64_t lo = 0, hi = 0;
+                for (size_t m = 0; m < n; ++m){
+                    const uint64_t* x = a + 2 * (i * n + m);
+                    const uint64_t* y = b + 2 * (j * n + m);
+                    uint64_t p0 = clmul(x[0], y[0]);
+                    lo ^= p0 ^ clmul(x[1], y[1]);
+                    hi ^= p0 ^ clmul(x[0] ^ x[1], y[0] ^ y[1]);
+                }
+                if ((lo | hi) != 0)
+                    return false;
+            }
+        }
+        return true;
+    }
+    Series s, t;
     for (size_t i = 0; i < k; ++i){
         for (size_t j = 0; j < other.k; ++j){
-            Series s;
+            s.assign(PackedSeries());
             size_t jj = j*n;
             for (size_t ii = i*n; ii < (i+1)*n; ++ii, ++jj){
-                s = s + generators[ii].inverse().conj() * other.generators[jj];
+                s += t.mulInto(generators[ii].inverse().conj(), other.generators[jj]);
             }
             s.strip();
             if (s.coeffs.size() != 1 || s.coeffs[0] != 0)
@@ -112,7 +168,42 @@ bool Code::isOrthogonal(Code& other){
     return true;
 }
 
-xlong Code::minDistance(){
+xlong Code::minDistance(xlong bound){
+    StatsTimer timer(MIN_DISTANCE_NS, MIN_DISTANCE_CALLS);
+    if (!validate()){
+        throw std::logic_error("Invalid code");
+    }
+    if (bound <= 0)
+        return bound;
+    xlong d;
+    if (fixedMinDistance(*this, d, bound))
+        return d;
+    if (Trellis::fits(*this))
+        return Trellis(*this).minDistance(bound);
+    return std::min(minDistanceOld(), bound);
+}
+
+bool Code::hasDistanceAtLeast(xlong d){
+    return minDistance(d) >= d;
+}
+
+DistanceOrder Code::compareDistance(xlong target){
+    xlong d = minDistance(target < INFTY ? target + 1 : target);
+    if (d < target)
+        return DISTANCE_BELOW;
+    return d == target ? DISTANCE_EQUAL : DISTANCE_ABOVE;
+}
+
+std::vector<xlong> Code::distanceSpectrum(size_t max_weight){
+    if (!validate()){
+        throw std::logic_error("Invalid code");
+    }
+    if (!Trellis::fits(*this))
+        throw std::logic_error("Code memory is too large");
+    return Trellis(*this).distanceSpectrum(max_weight);
+}
+
+xlong Code::minDistanceOld(){
     if (!validate()){
         throw std::logic_error("Invalid code");
     }
@@ -130,11 +221,19 @@ xlong Code::minDistance(){
     queue.push(std::make_pair<xlong, xlong>(0, 0));
     
     bool firstzero = true;
+    uint64_t pops = 0;
+    auto record = [&](){
+        if (statsEnabled()){
+            GlobalStats::instance().add(MIN_DISTANCE_OLD_POPS, pops);
+            GlobalStats::instance().add(MIN_DISTANCE_OLD_ENTRIES, d.size());
+        }
+    };
     while (!queue.empty()){
         xlong v = queue.top().second, curd = -queue.top().first;
         queue.pop();
+        ++pops;
         
-        if (!firstzero && v == 0) { return curd; }
+        if (!firstzero && v == 0) { record(); return curd; }
         if (curd > d[v]) continue;
         std::vector<std::vector<gf4>> state(k);
         for (size_t i = 0; i < k; ++i){
@@ -206,6 +305,7 @@ xlong Code::minDistance(){
         firstzero = false;
     }
 
+    record();
     return -1;
 }
 
@@ -224,6 +324,34 @@ std::string Code::toString() {
     return s;
 }
 
+// Representative of the code's equivalence class, see canonical.h:
+// every column shifted and scaled to constant coefficient 1 and padded
+// to maxSize(), conjugation and reversal chosen to give the smallest
+// sorted columns.
+Code Code::canonical(){
+    if (k != 1)
+        throw std::logic_error("Not implemented for k > 1");
+    if (!validate())
+        throw std::logic_error("Invalid code");
+    size_t length = maxSize();
+    if (2 * length > PACKED_CAPACITY)
+        throw std::logic_error("Code degree is too large");
+    std::vector<PackedSeries> columns;
+    for (auto& g: generators)
+        columns.push_back(normalizeColumn(g.pack(), length));
+    int t = canonicalTransform(columns, length);
+    std::vector<std::pair<ColumnKey, size_t>> order;
+    for (size_t i = 0; i < n; ++i){
+        columns[i] = transformColumn(columns[i], length, t);
+        order.push_back({columnKey(columns[i], length), i});
+    }
+    std::sort(order.begin(), order.end());
+    Code c(n, k);
+    for (auto& o: order)
+        c.generators.push_back(Series(columns[o.second]));
+    return c;
+}
+
 Code Code::findOrthogonalOld() {
     if (k != 1)
         throw new std::logic_error("Not implemented for k > 1");
@@ -293,7 +421,46 @@ std::shared_ptr<Code> CodeGenerator::next() {
     return c.first;
 }
 
+static bool isZeroSeries(const Series& s){
+    for (auto& c: s.coeffs)
+        if (c != 0)
+            return false;
+    return true;
+}
+
+// Rank of the generator matrix over rational functions in D, by
+// fraction-free elimination: a row is reduced by a pivot row through
+// row = pivot * row + row[c] * pivot_row, which clears column c.
+size_t Code::rank(){
+    std::vector<std::vector<Series>> basis;
+    std::vector<size_t> pivots;
+    Series a, t;
+    for (size_t i = 0; i < k; ++i){
+        std::vector<Series> row(generators.begin() + i * n, generators.begin() + (i + 1) * n);
+        for (size_t r = 0; r < basis.size(); ++r){
+            size_t c = pivots[r];
+            if (isZeroSeries(row[c]))
+                continue;
+            a = row[c];
+            for (size_t m = 0; m < n; ++m){
+                row[m].mulInto(basis[r][c], row[m]);
+                row[m] += t.mulInto(a, basis[r][m]);
+                row[m].strip();
+            }
+        }
+        size_t c = 0;
+        while (c < n && isZeroSeries(row[c]))
+            ++c;
+        if (c < n){
+            basis.push_back(row);
+            pivots.push_back(c);
+        }
+    }
+    return basis.size();
+}
+
 Code Code::findOrthogonal(){
+    StatsTimer timer(FIND_ORTHOGONAL_NS, FIND_ORTHOGONAL_CALLS);
     // set degrees of each generator in the orthogonal system
     size_t other_k = n - k;
     size_t other_degree = maxSize(0) - 1;
@@ -316,165 +483,114 @@ Code Code::findOrthogonal(){
         std::cerr << std::endl;
     }
 
-    // define index of each coefficient of the orthogonal system 
-    // in system of linear equations as shift + index in generator
-    std::vector<size_t> coeffs_shifts;
-    if (DEBUG){
-        std::cerr << "other_k: " << other_k << " " << "n: " << n << std::endl;
-    }
-    size_t M = 0;
-    for (size_t i = 0; i < other_k; ++i){
-        for (size_t j = 0; j < n; ++j){
-            coeffs_shifts.push_back(M);
-            M += other_degrees[i] + 1;
-        }
-    }
-    
-
-    // Preparing system of linear equations
-    std::vector<std::vector<gf4>> linear_system;
+    // Orthogonality to every row of this code only involves one row of
+    // the orthogonal system at a time, so the linear system is solved for
+    // each row on its own. Coefficient jj of column m is unknown
+    // m * (degree + 1) + jj.
+    std::vector<std::vector<std::vector<gf4>>> bases;
+    for (size_t j = 0; j < other_k; ++j){
+        size_t width = other_degrees[j] + 1;
+        size_t N = 0;
+        for (size_t i = 0; i < k; ++i)
+            N += maxSize(i) + other_degrees[j];
+        PackedMatrix linear_system(N, n * width);
 
-    size_t N = 0;
-    for (size_t i = 0; i < k; ++i){
-        size_t size = maxSize(i) - 1;
-        for (size_t j = 0; j < other_k; ++j){
-            for (size_t z = 0; z <= size + other_degrees[j]; ++z){
-                std::vector<gf4> v;
-                for (size_t zz = 0; zz < M; ++zz){
-                    v.push_back(gf4());
-                }
-                linear_system.push_back(v);
-            }
+        N = 0;
+        for (size_t i = 0; i < k; ++i){
+            size_t size = maxSize(i) - 1;
             for (size_t m = 0; m < n; ++m){
                 Series& this_generator = generators[i * n + m];
-                size_t other_generator_index = j * n + m;
                 for (size_t ii = 0; ii <= size; ++ii){
                     size_t p = size - ii;
-                    for (size_t jj = 0; jj <= other_degrees[j]; ++jj){
-                        linear_system[N + p + jj][coeffs_shifts[other_generator_index] + jj] = this_generator.at(ii).conj();
+                    for (size_t jj = 0; jj < width; ++jj){
+                        linear_system.set(N + p + jj, m * width + jj, this_generator.at(ii).conj());
                     }
                 }
             }
-            N += size + other_degrees[j] + 1;
-        }
-    }
-
-    if (DEBUG){
-        std::cerr << "---" << std::endl;
-        for (size_t i = 0; i < N; ++i){
-            for (size_t j = 0; j < M; ++j){
-                std::cerr << linear_system[i][j].toString() << " ";
-            }
-            std::cerr << std::endl;
+            N += size + width;
         }
-        std::cerr << "---" << std::endl;
-    }
 
-    // Upper-triangle
-    size_t most_left = 0;
-    for (size_t i = 0; i < N; ++i){
-        size_t j;
-        for(;;){
-            j = i;
-            while (j < N){
-                if (linear_system[j][most_left] != 0)
-                    break;
-                ++j;
-            }
-            if (j < N)
-                break;
-            ++most_left;
-            if (most_left == M)
-                break;
-        }
-        if (most_left == M)
-            break;
-        if (i != j)
-            std::swap(linear_system[i], linear_system[j]);
-        if (linear_system[i][most_left] != 1){
-            gf4 c = linear_system[i][most_left].conj();
-            for (size_t j = most_left; j < M; ++j)
-                linear_system[i][j] = linear_system[i][j] * c;
-        }
-        
-        for (size_t j = i + 1; j < N; ++j){
-            if (linear_system[j][most_left] != 0){
-                gf4 c = linear_system[j][most_left];
-                for (size_t jj = most_left; jj < M; ++jj)
-                    linear_system[j][jj] = linear_system[j][jj] + linear_system[i][jj] * c;
-            }
+        bases.push_back(linear_system.nullspace());
+        if (DEBUG){
+            std::cerr << "row " << j << ": nullspace of dimension " << bases.back().size() << std::endl;
         }
-
-        ++most_left;
-        if (most_left == M)
-            break;
     }
 
-    if (DEBUG){
-        std::cerr << "After getting to upper-triangle" << std::endl;
-        for (size_t i = 0; i < N; ++i){
-            for (size_t j = 0; j < M; ++j){
-                std::cerr << linear_system[i][j].toString() << " ";
-            }
-            std::cerr << std::endl;
+    // Rows with the fewest solutions are chosen first, the others have
+    // more room to stay independent of them. Candidates for a row are
+    // the sum of its basis, which rarely has short codewords, then the
+    // basis vectors in order. The first candidate independent of the
+    // rows chosen so far is taken, and if a later row has none the
+    // earlier rows move on to their next candidates.
+    std::vector<size_t> order(other_k);
+    for (size_t j = 0; j < other_k; ++j)
+        order[j] = j;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b){
+        return bases[a].size() < bases[b].size();
+    });
+
+    auto toRow = [&](size_t j, const std::vector<gf4>& x){
+        size_t width = other_degrees[j] + 1;
+        std::vector<Series> r;
+        for (size_t m = 0; m < n; ++m)
+            r.push_back(Series(std::vector<gf4>(x.begin() + m * width, x.begin() + (m + 1) * width)));
+        return r;
+    };
+
+    std::vector<std::vector<std::vector<gf4>>> candidates(other_k);
+    for (size_t j = 0; j < other_k; ++j){
+        auto& basis = bases[j];
+        if (basis.size() > 1){
+            std::vector<gf4> x(basis[0].size());
+            for (auto& b: basis)
+                for (size_t z = 0; z < x.size(); ++z)
+                    x[z] = x[z] + b[z];
+            candidates[j].push_back(x);
         }
+        candidates[j].insert(candidates[j].end(), basis.begin(), basis.end());
     }
 
-    // Assign values. What is the right way?
-    std::vector<gf4> values;
-    std::vector<bool> assigned;
-    for (size_t i = 0; i < M; ++i){
-        values.push_back(gf4());
-        assigned.push_back(false);
-    }
-    srand(M); // just a fixed initializer
-    for(int z__= 0;; ++z__){ 
-        for (size_t ii = 0; ii < N; ++ii){
-            size_t i = N - ii - 1;
-            size_t most_left = 0;
-            while (most_left < M && linear_system[i][most_left] == 0){
-                ++most_left;
-            }
-            if (most_left == M){
-                continue;
-            }
-            gf4 v = 0;
-            for (size_t j = most_left + 1; j < M; ++j){
-                if (!assigned[j]){
-                    // Here we need to make sure 
-                    // that generators are linearly independent(!)
-                    // This is not a good way.
-                    values[j] = gf4(rand() % 4);
-                    assigned[j] = true;
-                }
-                v = v + linear_system[i][j] * values[j];
-            }
-            values[most_left] = v;
-            assigned[most_left] = true;
+    // Greedy first: every row takes its first independent candidate.
+    // Only when that fails do earlier rows try their other candidates.
+    std::vector<std::vector<Series>> rows(other_k);
+    Code chosen(n, 0);
+    std::function<bool(size_t, bool)> choose = [&](size_t i, bool backtrack){
+        if (i == other_k)
+            return true;
+        size_t j = order[i];
+        chosen.k += 1;
+        for (auto& x: candidates[j]){
+            rows[j] = toRow(j, x);
+            chosen.generators.insert(chosen.generators.end(), rows[j].begin(), rows[j].end());
+            bool independent = chosen.rank() == chosen.k;
+            if (independent && choose(i + 1, backtrack))
+                return true;
+            chosen.generators.resize((chosen.k - 1) * n);
+            if (independent && !backtrack)
+                break;
         }
-        // check if generators are linearly independent
-        std::vector<Series> series;
-        for (size_t i = 0; i < other_k; ++i){
-            for (size_t j = 0; j < n; ++j){
-                std::vector<gf4> gen_coeffs;
-                size_t jj = coeffs_shifts[i * n + j];
-                for (size_t ii = 0; ii <= other_degrees[i]; ++ii, ++jj){
-                    gen_coeffs.push_back(values[jj]);
-                }
-                series.push_back(Series(gen_coeffs));
+        chosen.k -= 1;
+        return false;
+    };
+    if (!choose(0, false)){
+        // Any row is a combination of its basis over GF(4), so if all
+        // basis vectors together fall short of full rank over rational
+        // functions in D no choice of rows is independent.
+        Code all(n, 0);
+        for (size_t j = 0; j < other_k; ++j)
+            for (auto& x: bases[j]){
+                auto r = toRow(j, x);
+                all.generators.insert(all.generators.end(), r.begin(), r.end());
+                all.k += 1;
             }
-        }
-        Code c(series, n, other_k);;
-        if ((c.minDistance() != 0) || (z__ == 100)){
-            return c;
-        }
-        if (DEBUG){
-            std::cerr << c.toString() << std::endl;
-            std::cerr << "retry" << std::endl;
-        }
-        for (size_t i = 0; i < M; ++i){
-            values[i] = gf4(0);
-            assigned[i] = false;
-        }
+        if (all.k < other_k || all.rank() < other_k)
+            throw std::logic_error("No independent orthogonal rows of these degrees");
+        if (!choose(0, true))
+            throw std::logic_error("No independent orthogonal rows of these degrees");
     }
+
+    Code result(n, other_k);
+    for (auto& row: rows)
+        result.generators.insert(result.generators.end(), row.begin(), row.end());
+    return result;
 }
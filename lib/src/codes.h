@@ -33,6 +33,14 @@ class Combinations{
         std::shared_ptr<std::vector<std::vector<size_t>>> get();    
 };
 
+// Where a distance lies with respect to a target, see
+// Code::compareDistance().
+enum DistanceOrder{
+    DISTANCE_BELOW,
+    DISTANCE_EQUAL,
+    DISTANCE_ABOVE
+};
+
 class Code{
     public:
         std::vector<Series> generators;
@@ -51,10 +59,18 @@ class Code{
         size_t weight();
         bool isSelfOrthogonal();
         bool isOrthogonal(Code& other);
+        size_t rank();
         std::string toString();
-        xlong minDistance();
+        // With a bound, distances of bound or more are all returned as
+        // bound and their search ends there.
+        xlong minDistance(xlong bound = INFTY);
+        bool hasDistanceAtLeast(xlong d);
+        DistanceOrder compareDistance(xlong target);
+        xlong minDistanceOld();
+        std::vector<xlong> distanceSpectrum(size_t max_weight);
         Code findOrthogonalOld();
         Code findOrthogonal();
+        Code canonical();
 };
 
 class CodeGenerator {
@@ -0,0 +1,52 @@
+#include "fixed.h"
+
+using namespace cppcodes;
+
+template <size_t N, size_t MaxDegree>
+static xlong fixedDistance(const Code& code, xlong bound){
+    return FixedCode<N, MaxDegree>::fromCode(code).minDistance(bound);
+}
+
+template <size_t N, size_t MaxDegree>
+static xlong packedDistance(const PackedSeries* columns, xlong bound){
+    return FixedCode<N, MaxDegree>::fromPacked(columns).minDistance(bound);
+}
+
+typedef xlong (*FixedDistance)(const Code&, xlong);
+
+#define FIXED_DEGREES(N) { nullptr, \
+    &fixedDistance<N, 1>, &fixedDistance<N, 2>, &fixedDistance<N, 3>, &fixedDistance<N, 4>, \
+    &fixedDistance<N, 5>, &fixedDistance<N, 6>, &fixedDistance<N, 7> }
+
+#define PACKED_DEGREES(N) { nullptr, \
+    &packedDistance<N, 1>, &packedDistance<N, 2>, &packedDistance<N, 3>, &packedDistance<N, 4>, \
+    &packedDistance<N, 5>, &packedDistance<N, 6>, &packedDistance<N, 7> }
+
+static const FixedDistance FIXED_DISTANCE[FIXED_MAX_N + 1][FIXED_MAX_DEGREE + 1] = {
+    {}, {}, FIXED_DEGREES(2), FIXED_DEGREES(3), FIXED_DEGREES(4), FIXED_DEGREES(5), FIXED_DEGREES(6)
+};
+
+static const PackedDistance PACKED_DISTANCE[FIXED_MAX_N + 1][FIXED_MAX_DEGREE + 1] = {
+    {}, {}, PACKED_DEGREES(2), PACKED_DEGREES(3), PACKED_DEGREES(4), PACKED_DEGREES(5), PACKED_DEGREES(6)
+};
+
+PackedDistance cppcodes::fixedDistanceFor(size_t n, size_t degree){
+    if (n > FIXED_MAX_N || degree > FIXED_MAX_DEGREE)
+        return nullptr;
+    return PACKED_DISTANCE[n][degree];
+}
+
+bool cppcodes::fixedMinDistance(const Code& code, xlong& distance, xlong bound){
+    if (code.k != 1 || code.n > FIXED_MAX_N || code.generators.size() != code.n)
+        return false;
+    size_t size = 0;
+    for (auto& g: code.generators){
+        if (g.zero_shift != 0)
+            return false;
+        size = std::max(size, g.coeffs.size());
+    }
+    if (size < 2 || size - 1 > FIXED_MAX_DEGREE || !FIXED_DISTANCE[code.n][size - 1])
+        return false;
+    distance = FIXED_DISTANCE[code.n][size - 1](code, bound);
+    return true;
+}
@@ -0,0 +1,235 @@
+#ifndef FIXED_H
+#define FIXED_H
+
+#include "packed.h"
+#include "series.h"
+#include "codes.h"
+#include "stats.h"
+#include "branch.h"
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+
+// FixedCode<N, MaxDegree> is instantiated for 2 <= N <= FIXED_MAX_N and
+// 1 <= MaxDegree <= FIXED_MAX_DEGREE, see fixedMinDistance().
+const size_t FIXED_MAX_N = 6;
+const size_t FIXED_MAX_DEGREE = 7;
+
+namespace cppcodes{
+
+// Polynomial of degree at most MaxDegree in nonnegative powers, kept
+// inline as two bitplanes like PackedSeries. The degree bound is part of
+// the type, so a product's bound is known at compile time.
+template <size_t MaxDegree>
+class FixedSeries{
+    static_assert(MaxDegree < PACKED_CAPACITY, "Degree is too large");
+    public:
+        static const size_t SIZE = MaxDegree + 1;
+        static constexpr uint64_t MASK = SIZE >= 64 ? ~0ULL : (1ULL << SIZE) - 1;
+        uint64_t lo;
+        uint64_t hi;
+
+        constexpr FixedSeries(): lo(0), hi(0) {};
+        constexpr FixedSeries(uint64_t lo_, uint64_t hi_): lo(lo_ & MASK), hi(hi_ & MASK) {};
+        explicit FixedSeries(const Series& s): lo(0), hi(0) {
+            if (s.zero_shift != 0 || s.coeffs.size() > SIZE)
+                throw std::invalid_argument("Series does not fit");
+            for (size_t i = 0; i < s.coeffs.size(); ++i){
+                lo |= (uint64_t)(s.coeffs[i].value & 1) << i;
+                hi |= (uint64_t)(s.coeffs[i].value >> 1) << i;
+            }
+        };
+
+        explicit FixedSeries(const PackedSeries& s): lo(s.lo & MASK), hi(s.hi & MASK) {
+            if (s.zero_shift != 0 || s.size > SIZE)
+                throw std::invalid_argument("Series does not fit");
+        };
+
+        gf4 at(size_t i) const {
+            return gf4((char)(((lo >> i) & 1) | (((hi >> i) & 1) << 1)));
+        };
+
+        constexpr bool isZero() const { return (lo | hi) == 0; };
+        size_t weight() const { return __builtin_popcountll(lo | hi); };
+
+        constexpr FixedSeries operator+(const FixedSeries& b) const { return FixedSeries(lo ^ b.lo, hi ^ b.hi); };
+        FixedSeries& operator+=(const FixedSeries& b){ lo ^= b.lo; hi ^= b.hi; return *this; };
+        constexpr bool operator==(const FixedSeries& b) const { return lo == b.lo && hi == b.hi; };
+
+        template <size_t D>
+        FixedSeries<MaxDegree + D> operator*(const FixedSeries<D>& b) const {
+            uint64_t p0 = clmul(lo, b.lo);
+            uint64_t p2 = clmul(hi, b.hi);
+            uint64_t p1 = clmul(lo ^ hi, b.lo ^ b.hi);
+            return FixedSeries<MaxDegree + D>(p0 ^ p2, p1 ^ p0);
+        };
+
+        constexpr FixedSeries conj() const { return FixedSeries(lo ^ hi, hi); };
+
+        // Coefficient i moves to MaxDegree - i.
+        FixedSeries reverse() const {
+            return FixedSeries(reverseBits(lo) >> (64 - SIZE), reverseBits(hi) >> (64 - SIZE));
+        };
+
+        // g.inverse().conj() * g times D^MaxDegree, so no power is negative.
+        FixedSeries<2 * MaxDegree> autocorrelation() const {
+            return reverse().conj() * *this;
+        };
+
+        Series toSeries() const {
+            std::vector<gf4> coeffs(SIZE);
+            for (size_t i = 0; i < SIZE; ++i)
+                coeffs[i] = at(i);
+            return Series(coeffs);
+        };
+};
+
+// Buffers of fixedMinDistance() kept per thread, so that only the first
+// call on a thread allocates.
+struct FixedScratch{
+    std::vector<uint16_t> dist;
+    std::vector<std::vector<uint32_t>> buckets;
+
+    static FixedScratch& get(){
+        static thread_local FixedScratch scratch;
+        return scratch;
+    }
+};
+
+// Code with k = 1 whose N generators have degree at most MaxDegree.
+template <size_t N, size_t MaxDegree>
+class FixedCode{
+    static_assert(2 * N <= 64, "Too many generators");
+    public:
+        std::array<FixedSeries<MaxDegree>, N> columns;
+
+        FixedCode(): columns() {};
+
+        static FixedCode fromCode(const Code& c){
+            if (c.k != 1 || c.n != N || c.generators.size() != N)
+                throw std::invalid_argument("Code does not fit");
+            FixedCode f;
+            for (size_t i = 0; i < N; ++i)
+                f.columns[i] = FixedSeries<MaxDegree>(c.generators[i]);
+            return f;
+        };
+
+        static FixedCode fromPacked(const PackedSeries* columns){
+            FixedCode f;
+            for (size_t i = 0; i < N; ++i)
+                f.columns[i] = FixedSeries<MaxDegree>(columns[i]);
+            return f;
+        };
+
+        Code toCode() const {
+            std::vector<Series> generators;
+            for (auto& g: columns)
+                generators.push_back(g.toSeries());
+            return Code(generators, N, 1);
+        };
+
+        bool isSelfOrthogonal() const {
+            FixedSeries<2 * MaxDegree> s;
+            for (auto& g: columns)
+                s += g.autocorrelation();
+            return s.isZero();
+        };
+
+        // Same search as Trellis::minDistance with memory MaxDegree, but
+        // branch outputs are computed as the states are reached instead of
+        // being tabulated first: a state's output is the sum of the outputs
+        // of its digits, two bits per column. Below bound the distance is
+        // returned, otherwise bound.
+        xlong minDistance(xlong bound = INFTY) const {
+            const size_t L = MaxDegree;
+            const size_t STATES = (size_t)1 << (2 * L);
+            uint64_t digit_out[L][GF4_SIZE], input_out[GF4_SIZE];
+            for (size_t v = 0; v < GF4_SIZE; ++v){
+                for (size_t j = 0; j <= L; ++j){
+                    uint64_t out = 0;
+                    for (size_t c = 0; c < N; ++c)
+                        out |= (uint64_t)PROD[v][columns[c].at(L - j).value] << (2 * c);
+                    if (j < L)
+                        digit_out[j][v] = out;
+                    else
+                        input_out[v] = out;
+                }
+            }
+            const BranchWeights expand = branchWeights();
+            uint8_t w[GF4_SIZE];
+
+            FixedScratch& scratch = FixedScratch::get();
+            std::vector<uint16_t>& d = scratch.dist;
+            d.assign(STATES, UINT16_MAX);
+            auto& buckets = scratch.buckets;
+            buckets.resize(N + 1);
+            for (auto& b: buckets)
+                b.clear();
+            size_t pending = 0;
+            uint64_t pops = 0, relaxations = 0;
+
+            for (size_t u = 1; u < GF4_SIZE; ++u){
+                uint32_t v = u << (2 * (L - 1)), t = symbolWeight(input_out[u]);
+                if (t < d[v] && t < bound){
+                    d[v] = t;
+                    buckets[t].push_back(v);
+                    ++pending;
+                }
+            }
+
+            // zero inputs always lead back to state 0, so the queue only
+            // runs out first when every path is cut at bound
+            xlong result = bound;
+            for (uint32_t curd = 0; pending > 0; ++curd){
+                auto& bucket = buckets[curd % (N + 1)];
+                while (!bucket.empty()){
+                    uint32_t v = bucket.back();
+                    bucket.pop_back();
+                    --pending;
+                    if (d[v] != curd)
+                        continue;
+                    ++pops;
+                    if (v == 0){
+                        result = curd;
+                        pending = 0;
+                        break;
+                    }
+                    uint64_t out = 0;
+                    for (size_t j = 0; j < L; ++j)
+                        out ^= digit_out[j][(v >> (2 * j)) & 3];
+                    expand(out, input_out, GF4_SIZE, w);
+                    for (size_t u = 0; u < GF4_SIZE; ++u){
+                        uint32_t nv = (v >> 2) | (u << (2 * (L - 1)));
+                        uint32_t t = curd + w[u];
+                        if (t < d[nv] && t < bound){
+                            d[nv] = t;
+                            buckets[t % (N + 1)].push_back(nv);
+                            ++pending;
+                            ++relaxations;
+                        }
+                    }
+                }
+            }
+            if (statsEnabled()){
+                GlobalStats::instance().add(TRELLIS_POPS, pops);
+                GlobalStats::instance().add(TRELLIS_RELAXATIONS, relaxations);
+            }
+            return result;
+        };
+};
+
+// Distance of a k = 1 code through the FixedCode instantiation for its n
+// and degree, cut at bound like FixedCode::minDistance; false if there
+// is none.
+bool fixedMinDistance(const Code& code, xlong& distance, xlong bound = INFTY);
+
+// Distance of the k = 1 code with n packed `columns` of degree at most
+// `degree` if it is below `bound`, bound otherwise; nullptr if FixedCode
+// has no such instantiation.
+typedef xlong (*PackedDistance)(const PackedSeries* columns, xlong bound);
+PackedDistance fixedDistanceFor(size_t n, size_t degree);
+
+}
+
+#endif
@@ -0,0 +1,135 @@
+#include "incremental.h"
+#include "stats.h"
+#include "branch.h"
+#include <stdexcept>
+#include <algorithm>
+
+using namespace cppcodes;
+
+IncrementalDistance::IncrementalDistance(size_t n_, size_t degree_)
+: n(n_), degree(degree_), states((size_t)1 << (2 * degree_))
+, digit_out((n_ + 1) * degree_ * GF4_SIZE), input_out((n_ + 1) * GF4_SIZE)
+, to_zero(), ready(false), calls(0), dist(), buckets() {
+    if (!fits(n, degree))
+        throw std::invalid_argument("Code does not fit");
+}
+
+void IncrementalDistance::setColumn(size_t i, const PackedSeries& g){
+    for (size_t v = 0; v < GF4_SIZE; ++v){
+        for (size_t j = 0; j < degree; ++j){
+            size_t at = (i * degree + j) * GF4_SIZE + v;
+            digit_out[at + degree * GF4_SIZE] = digit_out[at]
+                | (uint64_t)PROD[v][g.at(degree - j).value] << (2 * i);
+        }
+        input_out[(i + 1) * GF4_SIZE + v] = input_out[i * GF4_SIZE + v]
+            | (uint64_t)PROD[v][g.at(0).value] << (2 * i);
+    }
+    if (i + 1 < n){
+        ready = false;
+        calls = 0;
+    }
+}
+
+// Dijkstra backwards from state 0 over the first n - 1 columns. The
+// predecessors of state t are the four states whose digits shifted
+// down by one give the lower digits of t, the input being its top digit.
+void IncrementalDistance::prepareToZero(){
+    const size_t L = degree, P = n - 1;
+    const uint32_t mask = (uint32_t)(states - 1);
+    to_zero.assign(states, UINT16_MAX);
+    buckets.resize(std::max(buckets.size(), n + 1));
+    for (auto& b: buckets)
+        b.clear();
+    to_zero[0] = 0;
+    buckets[0].push_back(0);
+    size_t pending = 1;
+    for (uint32_t curd = 0; pending > 0; ++curd){
+        auto& bucket = buckets[curd % (n + 1)];
+        while (!bucket.empty()){
+            uint32_t t = bucket.back();
+            bucket.pop_back();
+            --pending;
+            if (to_zero[t] != curd)
+                continue;
+            uint64_t in = input_out[P * GF4_SIZE + (t >> (2 * (L - 1)))];
+            for (uint32_t x = 0; x < GF4_SIZE; ++x){
+                uint32_t p = ((t << 2) & mask) | x;
+                uint32_t d = curd + symbolWeight(stateOut(P, p) ^ in);
+                if (d < to_zero[p]){
+                    to_zero[p] = d;
+                    buckets[d % (n + 1)].push_back(p);
+                    ++pending;
+                }
+            }
+        }
+    }
+    ready = true;
+}
+
+// A* from the first nonzero input back to state 0, states ordered by
+// their distance plus to_zero. to_zero never falls by more than a
+// branch weighs, so a state's distance is final once it is popped, and
+// no state whose estimate reaches bound needs to be queued.
+xlong IncrementalDistance::minDistance(xlong bound){
+    // the first code of a prefix is searched without estimates, the
+    // table only pays when several codes share it
+    if (!ready && ++calls > 1)
+        prepareToZero();
+    const size_t L = degree;
+    const uint64_t* in = &input_out[n * GF4_SIZE];
+    dist.assign(states, UINT16_MAX);
+    // estimates are at most n * (degree + 1) beyond the current one
+    size_t window = n * (L + 1) + 1;
+    buckets.resize(std::max(buckets.size(), window));
+    for (auto& b: buckets)
+        b.clear();
+    size_t pending = 0;
+    uint64_t pops = 0, relaxations = 0;
+    const BranchWeights expand = branchWeights();
+    uint8_t w[GF4_SIZE];
+
+    for (uint32_t u = 1; u < GF4_SIZE; ++u){
+        uint32_t v = u << (2 * (L - 1)), t = symbolWeight(in[u]);
+        if (t < dist[v] && t + zeroEstimate(v) < bound){
+            dist[v] = t;
+            buckets[(t + zeroEstimate(v)) % window].push_back(v);
+            ++pending;
+        }
+    }
+
+    // zero inputs always lead back to state 0, so the queue only runs
+    // out first when every path is cut at bound
+    xlong result = bound;
+    for (uint32_t f = 0; pending > 0; ++f){
+        auto& bucket = buckets[f % window];
+        while (!bucket.empty()){
+            uint32_t v = bucket.back();
+            bucket.pop_back();
+            --pending;
+            if (dist[v] + zeroEstimate(v) != f)
+                continue;
+            ++pops;
+            if (v == 0){
+                result = dist[v];
+                pending = 0;
+                break;
+            }
+            expand(stateOut(n, v), in, GF4_SIZE, w);
+            for (uint32_t u = 0; u < GF4_SIZE; ++u){
+                uint32_t nv = (v >> 2) | (u << (2 * (L - 1)));
+                uint32_t t = dist[v] + w[u];
+                if (t < dist[nv] && t + zeroEstimate(nv) < bound){
+                    dist[nv] = t;
+                    buckets[(t + zeroEstimate(nv)) % window].push_back(nv);
+                    ++pending;
+                    ++relaxations;
+                }
+            }
+        }
+    }
+    if (statsEnabled()){
+        GlobalStats::instance().add(TRELLIS_POPS, pops);
+        GlobalStats::instance().add(TRELLIS_RELAXATIONS, relaxations);
+    }
+    return result;
+}
@@ -0,0 +1,73 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include "packed.h"
+#include "codes.h"
+#include <vector>
+#include <cstdint>
+
+// Largest memory for which IncrementalDistance keeps per-state tables.
+const size_t INCREMENTAL_MAX_DEGREE = 10;
+
+namespace cppcodes{
+
+// Free distance of k = 1 codes whose columns are chosen one at a time,
+// depth first, as append() does. Branch outputs are kept per prefix of
+// columns, so setting column i only redoes the tables from i on. Codes
+// differing only in their last column share the distance from every
+// state back to state 0 in the code of the other columns: no path
+// weighs less with the last column than without it, so that distance
+// is a lower bound guiding an A* search of the whole code.
+class IncrementalDistance{
+    public:
+        IncrementalDistance(): n(0), degree(0), states(0), digit_out(), input_out(), to_zero(), ready(false)
+        , calls(0), dist(), buckets() {};
+        IncrementalDistance(size_t n_, size_t degree_);
+
+        static bool fits(size_t n, size_t degree){
+            return n >= 2 && 2 * n <= 64 && degree >= 1 && degree <= INCREMENTAL_MAX_DEGREE;
+        }
+
+        // Column i is g, of size degree + 1 and zero_shift 0.
+        void setColumn(size_t i, const PackedSeries& g);
+
+        // Distance of the code of the n columns set last if it is below
+        // bound, bound otherwise.
+        xlong minDistance(xlong bound = INFTY);
+
+    private:
+        size_t n;
+        size_t degree;
+        size_t states;
+        // outputs of the first i columns, i = 0..n: digit_out[(i * degree
+        // + j) * 4 + v] for lag digit j equal to v, input_out[i * 4 + v]
+        // for input v
+        std::vector<uint64_t> digit_out;
+        std::vector<uint64_t> input_out;
+        // distance of every state to state 0 in the code of the first
+        // n - 1 columns, valid while ready
+        std::vector<uint16_t> to_zero;
+        bool ready;
+        // minDistance() calls since the first n - 1 columns changed
+        size_t calls;
+        std::vector<uint16_t> dist;
+        std::vector<std::vector<uint32_t>> buckets;
+
+        uint64_t stateOut(size_t columns, uint32_t v) const {
+            const uint64_t* d = &digit_out[columns * degree * 4];
+            uint64_t out = 0;
+            for (size_t j = 0; j < degree; ++j, d += 4)
+                out ^= d[(v >> (2 * j)) & 3];
+            return out;
+        }
+
+        uint32_t zeroEstimate(uint32_t v) const {
+            return ready ? to_zero[v] : 0;
+        }
+
+        void prepareToZero();
+};
+
+}
+
+#endif
@@ -0,0 +1,167 @@
+#ifndef MATRIX_H
+#define MATRIX_H
+
+#include "gf4.h"
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+namespace cppcodes{
+
+// Bitplane products of GF(4) elements, lo + hi * u with u * u = u + 1.
+inline void mulPlanes(uint64_t alo, uint64_t ahi, uint64_t blo, uint64_t bhi, uint64_t& lo, uint64_t& hi){
+    uint64_t p0 = alo & blo, p2 = ahi & bhi;
+    lo = p0 ^ p2;
+    hi = ((alo ^ ahi) & (blo ^ bhi)) ^ p0;
+}
+
+// Dense matrix over GF(4). Every row is stored as two bitplanes of
+// `words` 64-bit words each, the same encoding as PackedSeries, so a
+// row is added to another, or multiplied by a constant, a word at a time.
+class PackedMatrix{
+    public:
+        size_t rows;
+        size_t cols;
+        size_t words;
+        std::vector<uint64_t> lo;
+        std::vector<uint64_t> hi;
+
+        PackedMatrix(size_t rows_, size_t cols_)
+        : rows(rows_)
+        , cols(cols_)
+        , words((cols_ + 63) / 64)
+        , lo(rows_ * words)
+        , hi(rows_ * words)
+        {};
+
+        gf4 at(size_t r, size_t c) const {
+            size_t i = r * words + c / 64, b = c % 64;
+            return gf4((char)(((lo[i] >> b) & 1) | (((hi[i] >> b) & 1) << 1)));
+        }
+
+        void set(size_t r, size_t c, gf4 v){
+            size_t i = r * words + c / 64, b = c % 64;
+            lo[i] = (lo[i] & ~(1ULL << b)) | ((uint64_t)(v.value & 1) << b);
+            hi[i] = (hi[i] & ~(1ULL << b)) | ((uint64_t)(v.value >> 1) << b);
+        }
+
+        bool isZeroRow(size_t r) const {
+            for (size_t w = 0; w < words; ++w)
+                if (lo[r * words + w] | hi[r * words + w])
+                    return false;
+            return true;
+        }
+
+        // First nonzero column of row r at or after `from`, cols if none.
+        size_t leading(size_t r, size_t from = 0) const {
+            for (size_t w = from / 64; w < words; ++w){
+                uint64_t x = lo[r * words + w] | hi[r * words + w];
+                if (w == from / 64)
+                    x &= ~0ULL << (from % 64);
+                if (x)
+                    return w * 64 + __builtin_ctzll(x);
+            }
+            return cols;
+        }
+
+        void swapRows(size_t a, size_t b){
+            if (a == b)
+                return;
+            std::swap_ranges(lo.begin() + a * words, lo.begin() + (a + 1) * words, lo.begin() + b * words);
+            std::swap_ranges(hi.begin() + a * words, hi.begin() + (a + 1) * words, hi.begin() + b * words);
+        }
+
+        // Row r times c, from the word holding column `from` on.
+        void scaleRow(size_t r, gf4 c, size_t from = 0){
+            uint64_t clo = -(uint64_t)(c.value & 1), chi = -(uint64_t)(c.value >> 1);
+            for (size_t w = r * words + from / 64; w < (r + 1) * words; ++w)
+                mulPlanes(lo[w], hi[w], clo, chi, lo[w], hi[w]);
+        }
+
+        // Adds row src times c to row dst, from the word holding column `from` on.
+        void addRow(size_t dst, size_t src, gf4 c, size_t from = 0){
+            uint64_t clo = -(uint64_t)(c.value & 1), chi = -(uint64_t)(c.value >> 1);
+            for (size_t w = from / 64; w < words; ++w){
+                uint64_t plo, phi;
+                mulPlanes(lo[src * words + w], hi[src * words + w], clo, chi, plo, phi);
+                lo[dst * words + w] ^= plo;
+                hi[dst * words + w] ^= phi;
+            }
+        }
+
+        // Sum over columns of row r times the packed vector (vlo, vhi).
+        gf4 dot(size_t r, const std::vector<uint64_t>& vlo, const std::vector<uint64_t>& vhi) const {
+            uint64_t plo = 0, phi = 0;
+            for (size_t w = 0; w < words; ++w){
+                uint64_t xlo, xhi;
+                mulPlanes(lo[r * words + w], hi[r * words + w], vlo[w], vhi[w], xlo, xhi);
+                plo ^= xlo;
+                phi ^= xhi;
+            }
+            return gf4((char)((__builtin_popcountll(plo) & 1) | ((__builtin_popcountll(phi) & 1) << 1)));
+        }
+
+        // Brings the matrix to row echelon form with leading coefficients 1
+        // and returns the pivot column of every nonzero row. With `reduced`
+        // the pivot columns are also cleared above the pivots.
+        std::vector<size_t> rowEchelon(bool reduced = false){
+            std::vector<size_t> pivots;
+            size_t col = 0;
+            for (size_t i = 0; i < rows && col < cols; ++i){
+                size_t j = rows;
+                for (; col < cols; ++col){
+                    size_t w = col / 64;
+                    uint64_t bit = 1ULL << (col % 64);
+                    for (j = i; j < rows; ++j)
+                        if ((lo[j * words + w] | hi[j * words + w]) & bit)
+                            break;
+                    if (j < rows)
+                        break;
+                }
+                if (col == cols)
+                    break;
+                swapRows(i, j);
+                gf4 c = at(i, col);
+                if (c != 1)
+                    scaleRow(i, c.conj(), col);
+                size_t w = col / 64;
+                uint64_t bit = 1ULL << (col % 64);
+                for (j = reduced ? 0 : i + 1; j < rows; ++j)
+                    if (j != i && ((lo[j * words + w] | hi[j * words + w]) & bit))
+                        addRow(j, i, at(j, col), col);
+                pivots.push_back(col);
+                ++col;
+            }
+            return pivots;
+        }
+
+        size_t rank() const {
+            PackedMatrix m(*this);
+            return m.rowEchelon().size();
+        }
+
+        // Basis of the solutions of m * x = 0, one free column per vector.
+        std::vector<std::vector<gf4>> nullspace() const {
+            PackedMatrix m(*this);
+            std::vector<size_t> pivots = m.rowEchelon(true);
+            std::vector<bool> is_pivot(cols);
+            for (auto p: pivots)
+                is_pivot[p] = true;
+            std::vector<std::vector<gf4>> basis;
+            for (size_t f = 0; f < cols; ++f){
+                if (is_pivot[f])
+                    continue;
+                std::vector<gf4> x(cols);
+                x[f] = 1;
+                // rows are reduced, so x[p] + m[i][f] = 0 with characteristic 2
+                for (size_t i = 0; i < pivots.size(); ++i)
+                    x[pivots[i]] = m.at(i, f);
+                basis.push_back(x);
+            }
+            return basis;
+        }
+};
+
+}
+
+#endif
@@ -0,0 +1,203 @@
+#ifndef PACKED_H
+#define PACKED_H
+
+#include "gf4.h"
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#if defined(__PCLMUL__)
+#include <wmmintrin.h>
+#endif
+
+namespace cppcodes{
+
+// Number of coefficients a PackedSeries can hold, one bit per plane each.
+const size_t PACKED_CAPACITY = 64;
+
+// Carry-less product of two GF(2) polynomials, truncated to 64 bits.
+inline uint64_t clmul(uint64_t a, uint64_t b){
+#if defined(__PCLMUL__)
+    __m128i r = _mm_clmulepi64_si128(_mm_cvtsi64_si128((long long)a), _mm_cvtsi64_si128((long long)b), 0);
+    return (uint64_t)_mm_cvtsi128_si64(r);
+#else
+    if (__builtin_popcountll(a) < __builtin_popcountll(b))
+        std::swap(a, b);
+    uint64_t r = 0;
+    while (b){
+        r ^= a << __builtin_ctzll(b);
+        b &= b - 1;
+    }
+    return r;
+#endif
+}
+
+// Full 128-bit carry-less product of two GF(2) polynomials: returns the
+// low 64 bits and stores the high ones in `high`.
+inline uint64_t clmulWide(uint64_t a, uint64_t b, uint64_t& high){
+#if defined(__PCLMUL__)
+    __m128i r = _mm_clmulepi64_si128(_mm_cvtsi64_si128((long long)a), _mm_cvtsi64_si128((long long)b), 0);
+    high = (uint64_t)_mm_cvtsi128_si64(_mm_srli_si128(r, 8));
+    return (uint64_t)_mm_cvtsi128_si64(r);
+#else
+    if (__builtin_popcountll(a) < __builtin_popcountll(b))
+        std::swap(a, b);
+    uint64_t r = 0;
+    high = 0;
+    while (b){
+        size_t i = __builtin_ctzll(b);
+        r ^= a << i;
+        if (i > 0)
+            high ^= a >> (64 - i);
+        b &= b - 1;
+    }
+    return r;
+#endif
+}
+
+// Carry-less product of GF(2) polynomials of several words each, the
+// lowest coefficients in word 0; out takes a_words + b_words words.
+inline void clmulWords(const uint64_t* a, size_t a_words, const uint64_t* b, size_t b_words, uint64_t* out){
+    std::fill(out, out + a_words + b_words, 0);
+    for (size_t i = 0; i < a_words; ++i){
+        if (a[i] == 0)
+            continue;
+        for (size_t j = 0; j < b_words; ++j){
+            uint64_t high;
+            out[i + j] ^= clmulWide(a[i], b[j], high);
+            out[i + j + 1] ^= high;
+        }
+    }
+}
+
+inline uint64_t reverseBits(uint64_t x){
+    x = ((x >> 1) & 0x5555555555555555ULL) | ((x & 0x5555555555555555ULL) << 1);
+    x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+    x = ((x >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((x & 0x0F0F0F0F0F0F0F0FULL) << 4);
+    return __builtin_bswap64(x);
+}
+
+inline uint64_t shiftLeft(uint64_t x, size_t i){ return i >= 64 ? 0 : x << i; }
+inline uint64_t shiftRight(uint64_t x, size_t i){ return i >= 64 ? 0 : x >> i; }
+inline uint64_t lowMask(size_t i){ return i >= 64 ? ~0ULL : (1ULL << i) - 1; }
+
+// GF(4) polynomial stored as two bitplanes: coefficient i is
+// bit i of lo plus twice bit i of hi, the same encoding as gf4::value,
+// so a coefficient reads as lo + hi * u. Layout of size and zero_shift
+// follows Series.
+class PackedSeries{
+    public:
+        uint64_t lo;
+        uint64_t hi;
+        size_t size;
+        size_t zero_shift;
+        PackedSeries(): lo(0), hi(0), size(1), zero_shift(0) {};
+        PackedSeries(uint64_t lo_, uint64_t hi_, size_t size_, size_t shift)
+        : lo(lo_ & lowMask(size_)), hi(hi_ & lowMask(size_)), size(size_), zero_shift(shift) {};
+
+        gf4 at(size_t i) const {
+            if (i >= size)
+                return gf4();
+            return gf4((char)(((lo >> i) & 1) | (((hi >> i) & 1) << 1)));
+        };
+
+        int min_power() const {
+            return -zero_shift;
+        };
+
+        int max_power() const {
+            return size - zero_shift - 1;
+        };
+
+        bool isZero() const {
+            return (lo | hi) == 0;
+        };
+
+        size_t weight() const {
+            return __builtin_popcountll(lo | hi);
+        };
+
+        PackedSeries& strip(){
+            if (size == 1)
+                return *this;
+            uint64_t nz = lo | hi;
+            size_t low = nz ? __builtin_ctzll(nz) : size;
+            if (low > zero_shift)
+                low = zero_shift;
+            lo = shiftRight(lo, low);
+            hi = shiftRight(hi, low);
+            size -= low;
+            zero_shift -= low;
+            nz = lo | hi;
+            size_t top = nz ? 64 - __builtin_clzll(nz) : 0;
+            size_t keep = std::max(top, zero_shift + 1);
+            if (keep < size)
+                size = keep;
+            return *this;
+        };
+
+        PackedSeries operator+(const PackedSeries& b) const {
+            size_t shift = std::max(zero_shift, b.zero_shift);
+            size_t a_off = shift - zero_shift, b_off = shift - b.zero_shift;
+            PackedSeries s(
+                shiftLeft(lo, a_off) ^ shiftLeft(b.lo, b_off),
+                shiftLeft(hi, a_off) ^ shiftLeft(b.hi, b_off),
+                std::max(size + a_off, b.size + b_off),
+                shift);
+            s.strip();
+            return s;
+        };
+
+        // (a0 + a1 u)(b0 + b1 u) = a0b0 + a1b1 + (a0b1 + a1b0 + a1b1) u,
+        // using three carry-less products.
+        PackedSeries operator*(const PackedSeries& b) const {
+            uint64_t p0 = clmul(lo, b.lo);
+            uint64_t p2 = clmul(hi, b.hi);
+            uint64_t p1 = clmul(lo ^ hi, b.lo ^ b.hi);
+            PackedSeries s(p0 ^ p2, p1 ^ p0, size + b.size - 1, zero_shift + b.zero_shift);
+            s.strip();
+            return s;
+        };
+
+        PackedSeries conj() const {
+            return PackedSeries(lo ^ hi, hi, size, zero_shift);
+        };
+
+        PackedSeries inverse() const {
+            PackedSeries s(
+                shiftRight(reverseBits(lo), 64 - size),
+                shiftRight(reverseBits(hi), 64 - size),
+                size, size - 1 - zero_shift);
+            s.strip();
+            return s;
+        };
+
+        bool operator==(const PackedSeries& o) const {
+            return lo == o.lo && hi == o.hi && size == o.size && zero_shift == o.zero_shift;
+        };
+
+        bool operator!=(const PackedSeries& o) const {
+            return !(*this == o);
+        };
+
+        bool operator<(const PackedSeries& o) const {
+            if (zero_shift != o.zero_shift)
+                return zero_shift < o.zero_shift;
+            if (size != o.size)
+                return size < o.size;
+            if (hi != o.hi)
+                return hi < o.hi;
+            return lo < o.lo;
+        };
+};
+
+struct PackedSeriesHasher{
+    std::size_t operator()(const PackedSeries& s) const {
+        uint64_t h = s.lo * 0x9E3779B97F4A7C15ULL;
+        h ^= (s.hi + 0x632BE59BD9B4E019ULL + (h << 6) + (h >> 2)) * 0xC2B2AE3D27D4EB4FULL;
+        h ^= (uint64_t)s.size << 32 ^ (uint64_t)s.zero_shift;
+        return std::hash<uint64_t>{}(h);
+    }
+};
+}
+
+#endif
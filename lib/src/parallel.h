@@ -0,0 +1,87 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <exception>
+
+namespace cppcodes{
+
+// Number of worker threads to use for `tasks` tasks, 0 meaning one per core.
+inline size_t workerCount(size_t threads, size_t tasks){
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    if (threads > tasks)
+        threads = tasks;
+    return threads == 0 ? 1 : threads;
+}
+
+// Calls task(i, worker) for every i in [0, count) on `threads` workers,
+// threads having been resolved by workerCount. Each worker starts with a
+// contiguous block of indices and runs them front to back; a worker that
+// runs dry steals from the back of another worker's block. The first
+// exception thrown by a task stops the workers and is rethrown.
+template <typename F>
+void parallelFor(size_t count, size_t threads, F task){
+    struct Queue{
+        std::mutex lock;
+        std::deque<size_t> tasks;
+    };
+    std::vector<Queue> queues(threads);
+    for (size_t w = 0; w < threads; ++w)
+        for (size_t i = w * count / threads; i < (w + 1) * count / threads; ++i)
+            queues[w].tasks.push_back(i);
+
+    std::atomic<bool> failed(false);
+    std::exception_ptr error;
+    std::mutex error_lock;
+    auto worker = [&](size_t w){
+        while (!failed.load(std::memory_order_relaxed)){
+            size_t t = 0;
+            bool found = false;
+            {
+                std::lock_guard<std::mutex> guard(queues[w].lock);
+                if (!queues[w].tasks.empty()){
+                    t = queues[w].tasks.front();
+                    queues[w].tasks.pop_front();
+                    found = true;
+                }
+            }
+            for (size_t j = 1; !found && j < threads; ++j){
+                Queue& victim = queues[(w + j) % threads];
+                std::lock_guard<std::mutex> guard(victim.lock);
+                if (!victim.tasks.empty()){
+                    t = victim.tasks.back();
+                    victim.tasks.pop_back();
+                    found = true;
+                }
+            }
+            if (!found)
+                return;
+            try {
+                task(t, w);
+            } catch (...) {
+                std::lock_guard<std::mutex> guard(error_lock);
+                if (!error)
+                    error = std::current_exception();
+                failed = true;
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (size_t w = 1; w < threads; ++w)
+        pool.emplace_back(worker, w);
+    worker(0);
+    for (auto& t: pool)
+        t.join();
+    if (error)
+        std::rethrow_exception(error);
+}
+
+}
+
+#endif
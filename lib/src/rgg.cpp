@@ -0,0 +1,247 @@
+#include "rgg.h"
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdio>
+#if defined(_WIN32)
+#include <process.h>
+#define getpid _getpid
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace cppcodes;
+
+static const uint64_t RGG_MAGIC = 0x3147475253444f43ULL; // "CODSRGG1"
+static const uint64_t RGG_VERSION = 2;
+static const size_t RGG_HEADER = 6;
+
+static size_t tableWords(size_t count, size_t total, size_t slot_count){
+    return RGG_HEADER + 6 * count + 1 + 2 * total + slot_count;
+}
+
+RggTable RggTable::build(size_t degree){
+    if (2 * degree + 1 > PACKED_CAPACITY)
+        throw std::invalid_argument("Degree is too large");
+    // series in enumeration order: constant coefficient 1, then the
+    // higher coefficients counted up as a base 4 number, degree first
+    std::vector<PackedSeries> all, autocorrelations;
+    std::vector<PackedSeries> keys;
+    std::unordered_map<PackedSeries, size_t, PackedSeriesHasher> index;
+    for (uint64_t x = 0; x < ((uint64_t)1 << (2 * degree)); ++x){
+        uint64_t lo = 1, hi = 0;
+        for (size_t i = 1; i <= degree; ++i){
+            uint64_t c = (x >> (2 * (degree - i))) & 3;
+            lo |= (c & 1) << i;
+            hi |= (c >> 1) << i;
+        }
+        PackedSeries p(lo, hi, degree + 1, 0);
+        all.push_back(p);
+        autocorrelations.push_back(p.inverse().conj() * p);
+        if (index.insert({autocorrelations.back(), 0}).second)
+            keys.push_back(autocorrelations.back());
+    }
+    std::sort(keys.begin(), keys.end());
+    for (size_t j = 0; j < keys.size(); ++j)
+        index[keys[j]] = j;
+
+    size_t slot_count = 2;
+    while (slot_count < 2 * keys.size())
+        slot_count *= 2;
+
+    RggTable t;
+    t.degree = degree;
+    std::vector<uint64_t>& w = t.words;
+    w.assign(tableWords(keys.size(), all.size(), slot_count), 0);
+    w[0] = RGG_MAGIC;
+    w[1] = RGG_VERSION;
+    w[2] = degree;
+    w[3] = keys.size();
+    w[4] = all.size();
+    w[5] = slot_count;
+    uint64_t* pk = &w[RGG_HEADER];
+    uint64_t* pc = pk + 4 * keys.size();
+    uint64_t* po = pc + keys.size();
+    uint64_t* ps = po + keys.size() + 1;
+    uint64_t* pslots = ps + 2 * all.size();
+    for (size_t j = 0; j < keys.size(); ++j){
+        pk[4 * j] = keys[j].lo;
+        pk[4 * j + 1] = keys[j].hi;
+        pk[4 * j + 2] = keys[j].size;
+        pk[4 * j + 3] = keys[j].zero_shift;
+        pc[j] = index[keys[j].conj()];
+        uint64_t h = hash(keys[j]);
+        size_t i = h & (slot_count - 1);
+        while (pslots[i] != 0)
+            i = (i + 1) & (slot_count - 1);
+        pslots[i] = (h >> 32 << 32) | (j + 1);
+    }
+    // counting sort by key keeps enumeration order within a bucket
+    std::vector<size_t> key_of(all.size());
+    for (size_t i = 0; i < all.size(); ++i){
+        key_of[i] = index[autocorrelations[i]];
+        ++po[key_of[i] + 1];
+    }
+    for (size_t j = 0; j < keys.size(); ++j)
+        po[j + 1] += po[j];
+    std::vector<uint64_t> fill(po, po + keys.size());
+    for (size_t i = 0; i < all.size(); ++i){
+        size_t at = fill[key_of[i]]++;
+        ps[2 * at] = all[i].lo;
+        ps[2 * at + 1] = all[i].hi;
+    }
+    t.attach(w.data(), w.size());
+    return t;
+}
+
+void RggTable::attach(const uint64_t* d, size_t length){
+    if (length < RGG_HEADER || d[0] != RGG_MAGIC || d[1] != RGG_VERSION)
+        throw std::runtime_error("Not an Rgg table");
+    degree = d[2];
+    count = d[3];
+    total = d[4];
+    size_t slot_count = d[5];
+    if (2 * degree + 1 > PACKED_CAPACITY || count >= 0xFFFFFFFFULL || total > length || slot_count > length
+        || slot_count < 2 || slot_count < 2 * count || (slot_count & (slot_count - 1)) != 0
+        || length != tableWords(count, total, slot_count))
+        throw std::runtime_error("Corrupted Rgg table");
+    slot_mask = slot_count - 1;
+    data = d;
+    keys = d + RGG_HEADER;
+    conjs = keys + 4 * count;
+    offsets = conjs + count;
+    series_data = offsets + count + 1;
+    slots = series_data + 2 * total;
+
+    // Lookups trust every index in the table, so a mapped file is checked
+    // once here: keys fit a PackedSeries, conjugates and slots point at
+    // keys, offsets run from 0 to total without going back, and some
+    // slot is empty so that a probe for a missing key ends.
+    bool ok = offsets[0] == 0 && offsets[count] == total;
+    for (size_t j = 0; j < count && ok; ++j)
+        ok = keys[4 * j + 2] >= 1 && keys[4 * j + 2] <= PACKED_CAPACITY && keys[4 * j + 3] < keys[4 * j + 2]
+            && conjs[j] < count && offsets[j] <= offsets[j + 1];
+    size_t used = 0;
+    for (size_t i = 0; i < slot_count && ok; ++i)
+        if (slots[i] != 0){
+            ok = (slots[i] & 0xFFFFFFFFULL) - 1 < count;
+            ++used;
+        }
+    if (!ok || used != count)
+        throw std::runtime_error("Corrupted Rgg table");
+}
+
+RggTable RggTable::open(const std::string& path){
+    RggTable t;
+#if defined(_WIN32)
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in)
+        throw std::runtime_error("Cannot open " + path);
+    size_t bytes = in.tellg();
+    in.seekg(0);
+    t.words.resize(bytes / sizeof(uint64_t));
+    in.read((char*)t.words.data(), t.words.size() * sizeof(uint64_t));
+    if (!in || bytes % sizeof(uint64_t) != 0)
+        throw std::runtime_error("Cannot read " + path);
+    t.attach(t.words.data(), t.words.size());
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Cannot open " + path);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0 || st.st_size % sizeof(uint64_t) != 0){
+        ::close(fd);
+        throw std::runtime_error("Not an Rgg table");
+    }
+    void* m = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (m == MAP_FAILED)
+        throw std::runtime_error("Cannot map " + path);
+    t.mapped = m;
+    t.mapped_size = st.st_size;
+    t.attach((const uint64_t*)m, st.st_size / sizeof(uint64_t));
+#endif
+    return t;
+}
+
+// True if path is missing or holds a table of an older version.
+static bool needsBuild(const std::string& path){
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return true;
+    uint64_t header[2] = {0, 0};
+    in.read((char*)header, sizeof(header));
+    return in && header[0] == RGG_MAGIC && header[1] < RGG_VERSION;
+}
+
+RggTable RggTable::openOrBuild(const std::string& path, size_t degree){
+    if (needsBuild(path)){
+        std::string tmp = path + ".tmp" + std::to_string(getpid());
+        build(degree).save(tmp);
+        if (std::rename(tmp.c_str(), path.c_str()) != 0){
+            std::remove(tmp.c_str());
+            throw std::runtime_error("Cannot write " + path);
+        }
+    }
+    RggTable t = open(path);
+    if (t.degree != degree)
+        throw std::invalid_argument("Rgg table " + path + " is of another degree");
+    return t;
+}
+
+void RggTable::save(const std::string& path) const {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write((const char*)data, tableWords(count, total, slot_mask + 1) * sizeof(uint64_t));
+    out.close();
+    if (!out)
+        throw std::runtime_error("Cannot write " + path);
+}
+
+void RggTable::release(){
+#if !defined(_WIN32)
+    if (mapped)
+        munmap(mapped, mapped_size);
+#endif
+    mapped = nullptr;
+    mapped_size = 0;
+    words.clear();
+    data = nullptr;
+}
+
+RggTable::RggTable(RggTable&& o)
+: RggTable()
+{
+    *this = std::move(o);
+}
+
+RggTable& RggTable::operator=(RggTable&& o){
+    if (this == &o)
+        return *this;
+    release();
+    degree = o.degree;
+    count = o.count;
+    total = o.total;
+    data = o.data;
+    keys = o.keys;
+    conjs = o.conjs;
+    offsets = o.offsets;
+    series_data = o.series_data;
+    slots = o.slots;
+    slot_mask = o.slot_mask;
+    mapped = o.mapped;
+    mapped_size = o.mapped_size;
+    words = std::move(o.words);
+    o.mapped = nullptr;
+    o.mapped_size = 0;
+    o.data = nullptr;
+    o.count = o.total = 0;
+    return *this;
+}
+
+RggTable::~RggTable(){
+    release();
+}
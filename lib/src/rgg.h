@@ -0,0 +1,112 @@
+#ifndef RGG_H
+#define RGG_H
+
+#include "packed.h"
+#include <vector>
+#include <string>
+#include <cstdint>
+
+namespace cppcodes{
+
+// Table of every series of a degree with constant coefficient 1, grouped
+// by autocorrelation g.inverse().conj() * g. Autocorrelations (keys) are
+// sorted, series of a key keep the order in which they are enumerated.
+//
+// The table is one array of 64-bit words in native byte order, the same
+// in memory and on disk, so a saved table is used straight from mmap:
+//     magic, version, degree, key count, series count, slot count,
+//     keys:    lo, hi, size, zero_shift for every key,
+//     conj:    index of the conjugate of every key,
+//     offsets: key count + 1 offsets into series,
+//     series:  lo, hi for every series (size degree + 1, zero_shift 0),
+//     slots:   open addressing index of the keys, a power of two at
+//              least twice the key count; a slot holds the high half of
+//              the key's hash and its index + 1, 0 if empty.
+class RggTable{
+    public:
+        static RggTable build(size_t degree);
+        // Maps a table written by save(); throws std::runtime_error if the
+        // file is missing or is not a table of this format.
+        static RggTable open(const std::string& path);
+        // Opens the table at path, building and saving it first if it is
+        // missing or was saved by an older version.
+        // The file is written under a temporary name and renamed, so
+        // processes starting at once never see a partial table.
+        static RggTable openOrBuild(const std::string& path, size_t degree);
+
+        RggTable()
+        : degree(0), count(0), total(0), slot_mask(0), data(nullptr), keys(nullptr), conjs(nullptr)
+        , offsets(nullptr), series_data(nullptr), slots(nullptr), mapped(nullptr), mapped_size(0), words() {};
+        RggTable(RggTable&& o);
+        RggTable& operator=(RggTable&& o);
+        RggTable(const RggTable&) = delete;
+        RggTable& operator=(const RggTable&) = delete;
+        ~RggTable();
+
+        void save(const std::string& path) const;
+
+        size_t getDegree() const { return degree; }
+        size_t size() const { return count; }
+        size_t seriesCount() const { return total; }
+
+        PackedSeries key(size_t j) const {
+            const uint64_t* p = keys + 4 * j;
+            return PackedSeries(p[0], p[1], p[2], p[3]);
+        }
+
+        size_t conj(size_t j) const { return conjs[j]; }
+        size_t bucketSize(size_t j) const { return offsets[j + 1] - offsets[j]; }
+
+        PackedSeries series(size_t j, size_t i) const {
+            const uint64_t* p = series_data + 2 * (offsets[j] + i);
+            return PackedSeries(p[0], p[1], degree + 1, 0);
+        }
+
+        // Hash of the slot index; fixed here rather than taken from
+        // std::hash so that saved tables read the same everywhere.
+        static uint64_t hash(const PackedSeries& s){
+            uint64_t h = s.lo * 0x9E3779B97F4A7C15ULL;
+            h ^= s.hi * 0xC2B2AE3D27D4EB4FULL + ((uint64_t)s.size << 32 | s.zero_shift);
+            h ^= h >> 29;
+            h *= 0xBF58476D1CE4E5B9ULL;
+            return h ^ (h >> 32);
+        }
+
+        // Index of key s, size() if s is not a key.
+        size_t find(const PackedSeries& s) const {
+            uint64_t h = hash(s), tag = h >> 32 << 32;
+            for (size_t i = h & slot_mask;; i = (i + 1) & slot_mask){
+                uint64_t slot = slots[i];
+                if (slot == 0)
+                    return count;
+                if ((slot & ~0xFFFFFFFFULL) == tag){
+                    size_t j = (slot & 0xFFFFFFFFULL) - 1;
+                    if (key(j) == s)
+                        return j;
+                }
+            }
+        }
+
+    private:
+        size_t degree;
+        size_t count;
+        size_t total;
+        size_t slot_mask;
+        const uint64_t* data;
+        const uint64_t* keys;
+        const uint64_t* conjs;
+        const uint64_t* offsets;
+        const uint64_t* series_data;
+        const uint64_t* slots;
+        // the mapping of an opened table, or words of a built one
+        void* mapped;
+        size_t mapped_size;
+        std::vector<uint64_t> words;
+
+        void attach(const uint64_t* d, size_t length);
+        void release();
+};
+
+}
+
+#endif
@@ -3,30 +3,325 @@
 
 #include <stdexcept>
 #include <memory>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
 #include "codes.h"
 #include "series.h"
 #include "gf4.h"
+#include "parallel.h"
+#include "canonical.h"
+#include "rgg.h"
+#include "stats.h"
+#include "fixed.h"
+#include "matrix.h"
+#include "incremental.h"
+#include <array>
+#include <unordered_map>
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <atomic>
+
+// Top levels of generate() are split into at least this many tasks per thread.
+const size_t TASKS_PER_THREAD = 64;
+// A shard is cut from at least this many tasks per shard, see shardTasks().
+const size_t TASKS_PER_SHARD = 256;
+// A checkpointed search checks the clock after this many nodes.
+const size_t CHECKPOINT_SLICE = 1 << 16;
+// A walk reports its progress and checks for cancellation every this
+// many nodes; a power of two.
+const size_t PROGRESS_NODES = 1 << 12;
+// Inputs of degree up to this are used as probe paths for distance bounds.
+const size_t PROBE_DEGREE = 2;
+// Default memory for the key tuples of SuffixJoin, in bytes.
+const size_t JOIN_MEMORY = (size_t)1 << 28;
+// Right halves of a further row of a k > 1 code are tabulated for up to
+// this many basis vectors, 4^ROW_JOIN_DIGITS of them; see prepareRow().
+const size_t ROW_JOIN_DIGITS = 8;
 
 namespace cppcodes{
+
+// Position of a search in the order generate() visits it: key indices of
+// the first n - 1 levels of generate() followed by preimage indices of
+// the n levels of append() and, for k > 1, the digits and table index of
+// every further row in extendRows(). A shorter position stands for the
+// first leaf below it, an empty one for the beginning of the search.
+struct SearchCursor{
+    std::vector<size_t> position;
+    bool done;
+    SearchCursor(): position(), done(false) {};
+};
+
+// Thrown by a search cancelled through SearchSelfOrthogonal::cancel().
+class SearchCancelled: public std::runtime_error{
+public:
+    SearchCancelled(): std::runtime_error("Search cancelled") {};
+};
+
+// Progress of the searches of one SearchSelfOrthogonal, written by its
+// walks and read from any thread while they run.
+struct SearchControl{
+    std::atomic<uint64_t> nodes;
+    std::atomic<uint64_t> codes;
+    std::atomic<uint64_t> tasks_done;
+    std::atomic<uint64_t> tasks;
+    std::atomic<size_t> running;
+    std::atomic<bool> cancelled;
+    SearchControl(): nodes(0), codes(0), tasks_done(0), tasks(0), running(0), cancelled(false) {};
+};
+
+// Snapshot of a SearchControl. tasks is 0 for a serial search, which is
+// not split into tasks.
+struct SearchProgress{
+    uint64_t nodes;
+    uint64_t codes;
+    uint64_t tasks_done;
+    uint64_t tasks;
+    bool running;
+};
+
+// How extendRows() enumerates row i > 0 of a k > 1 code: combinations of
+// `outer`, then `left`, then `right` basis vectors of n columns each.
+// Left vectors are zero on columns [n / 2, n) and right ones on [0, n / 2),
+// so with the outer digits fixed the two halves of the row add their
+// autocorrelations independently.
+struct RowSplit{
+    size_t outer;
+    size_t left;
+    size_t right;
+    std::vector<PackedSeries> basis;
+    // columns [n / 2, n) of the row with the outer digits chosen so far,
+    // and the combinations of the right vectors added to them, bucketed
+    // by autocorrelation key, see prepareRight()
+    std::vector<PackedSeries> base;
+    std::vector<uint64_t> keys;
+    std::vector<uint64_t> combos;
+    std::vector<uint32_t> offsets;
+    // scratch of prepareRight()
+    std::vector<PackedSeries> current;
+    std::vector<uint64_t> unsorted;
+    std::vector<uint32_t> fill;
+    RowSplit(): outer(0), left(0), right(0), basis(), base(), keys(), combos(), offsets(), current(), unsorted(), fill() {};
+};
+
+// State of one walk over the search tree: where found codes go, the
+// current position, the position to resume from and when to stop. A
+// node is a child considered by generate() or append(), pruned or not.
+struct SearchWalk{
+    std::vector<Code>* out;
+    std::vector<size_t> path;
+    std::vector<size_t> from;
+    bool resume;
+    size_t limit;
+    size_t found;
+    size_t nodes;
+    size_t node_limit;
+    bool stopped;
+    // where nodes and codes are reported, nullptr for none, and how many
+    // were reported so far
+    SearchControl* control;
+    size_t reported_nodes;
+    size_t reported_found;
+    // counters of this walk, kept only when statistics are enabled
+    bool counting;
+    uint64_t started;
+    StatsCounts counts;
+    // probe weights accumulated per level and bucket bounds of the
+    // columns append() has not reached yet, see prepareBounds()
+    std::vector<int> bound;
+    std::vector<int> suffix;
+    // scratch kept for the whole walk, so that nodes and leaves stop
+    // allocating once it has grown: the columns append() has chosen and
+    // buffers of the canonical checks
+    std::vector<PackedSeries> columns;
+    std::vector<size_t> conj_keys;
+    std::vector<ColumnKey> own_keys;
+    std::vector<ColumnKey> transformed_keys;
+    // for k > 1: how every further row is enumerated and the reduced
+    // constant coefficients of the rows above, see extendRows()
+    std::vector<RowSplit> rows;
+    std::vector<std::array<uint64_t, 3>> constant_rows;
+    // distance of row 0 kept up to date by append(), see incremental.h
+    IncrementalDistance distance;
+    SearchWalk(std::vector<Code>* out_, size_t limit_ = SIZE_MAX, size_t node_limit_ = SIZE_MAX)
+    : out(out_), path(), from(), resume(false), limit(limit_), found(0), nodes(0), node_limit(node_limit_)
+    , stopped(false), control(nullptr), reported_nodes(0), reported_found(0), counting(statsEnabled()), started(counting ? statsClock() : 0), counts()
+    , bound(), suffix(), columns(), conj_keys(), own_keys(), transformed_keys()
+    , rows(), constant_rows(), distance() {};
+
+    void count(size_t counter, uint64_t v = 1){
+        if (counting)
+            counts[counter] += v;
+    }
+
+    // Reports the nodes and codes since the last call to the control;
+    // true once the search is cancelled.
+    bool poll(){
+        if (!control)
+            return false;
+        control->nodes += nodes - reported_nodes;
+        control->codes += found - reported_found;
+        reported_nodes = nodes;
+        reported_found = found;
+        return control->cancelled.load(std::memory_order_relaxed);
+    }
+
+    // Counts a node at child j and stops before it once node_limit nodes
+    // were visited or the search is cancelled; the path then points at
+    // the child. Nodes on the resume spine were counted by the walk that
+    // stopped there and are free, so every walk gets past its cursor.
+    bool budget(size_t j){
+        if (resume)
+            return true;
+        if (++nodes <= node_limit && ((nodes & (PROGRESS_NODES - 1)) != 0 || !poll()))
+            return true;
+        path.push_back(j);
+        stopped = true;
+        return false;
+    }
+
+    // The same for a child reached through `count` levels at once.
+    bool budget(const uint32_t* js, size_t count){
+        if (resume)
+            return true;
+        if (++nodes <= node_limit && ((nodes & (PROGRESS_NODES - 1)) != 0 || !poll()))
+            return true;
+        path.insert(path.end(), js, js + count);
+        stopped = true;
+        return false;
+    }
+
+    // first index to visit at `level`, leaves the resume spine once
+    // the saved position is used up
+    size_t start(size_t level){
+        if (!resume)
+            return 0;
+        if (level < from.size())
+            return from[level];
+        resume = false;
+        return 0;
+    }
+};
+
+// Key tuples of the last `levels` levels of generate() grouped by their
+// sum. Keys add up to zero, so a prefix with sum s continues with the
+// tuples of group s; tuples of a group keep the order generate() visits
+// them in. In canonical mode only nondecreasing tuples are kept.
+struct SuffixJoin{
+    size_t levels;
+    std::unordered_map<PackedSeries, std::pair<size_t, size_t>, PackedSeriesHasher> groups;
+    std::vector<uint32_t> tuples;
+};
+
 class SearchSelfOrthogonal{
 private:
     bool warm;
     size_t n;
     size_t degree;
     size_t k;
-    std::unordered_multimap<Series, std::shared_ptr<std::vector<Series>>, SeriesHasher> Rgg;
-    std::vector<Code> codes;
+    xlong min_distance;
+    bool canonical;
+    // series grouped by autocorrelation, see rgg.h; loaded from
+    // table_path when it is set
+    std::string table_path;
+    std::shared_ptr<const RggTable> table;
+    // FixedCode distance for this n and degree, nullptr if there is none
+    PackedDistance fixed_distance;
+    // whether append() keeps an IncrementalDistance of row 0, for codes
+    // FixedCode has no instantiation for
+    bool incremental;
+    // distance bounds, see prepareBounds()
+    std::vector<PackedSeries> probes;
+    std::vector<std::vector<int>> probe_weights;
+    std::vector<int> key_bound;
+    std::vector<int> any_bound;
+    // suffixes of generate(), see prepareJoin(); nullptr when they would
+    // take more than join_memory bytes or n is too small to gain
+    size_t join_memory;
+    bool join_ready;
+    std::shared_ptr<const SuffixJoin> join;
+    // counters of every walk of this search, see stats.h
+    std::mutex stats_lock;
+    StatsCounts stats;
+    // held while the table, bounds and join are prepared, so that calls
+    // from several threads prepare them once
+    std::mutex prepare_lock;
+    // held while the parameters change and while a call starts, so that
+    // they stay fixed while any call runs
+    std::mutex params_lock;
+    // progress and cancellation of the running calls, see cancel()
+    SearchControl control;
+
+    // Counts a running call, params_lock held; the first of a batch of
+    // concurrent calls clears an old cancellation.
+    void enter(bool reset){
+        if (control.running++ == 0)
+            control.cancelled = false;
+        if (reset){
+            control.nodes = 0;
+            control.codes = 0;
+            control.tasks_done = 0;
+            control.tasks = 0;
+        }
+    }
+
+    // Counts a running call for the lifetime of the object.
+    struct Running{
+        SearchSelfOrthogonal& search;
+        Running(SearchSelfOrthogonal& search_, bool reset): search(search_) {
+            std::lock_guard<std::mutex> guard(search.params_lock);
+            search.enter(reset);
+        };
+        ~Running(){
+            --search.control.running;
+        };
+    };
+
+    // Parameters only change while no call runs.
+    void checkIdle(bool changes){
+        if (changes && control.running > 0)
+            throw std::logic_error("Cannot change the parameters of a running search");
+    }
+
+    void checkCancelled(){
+        if (control.cancelled)
+            throw SearchCancelled();
+    }
 public:
     SearchSelfOrthogonal(size_t n_, size_t degree_, size_t k_=1)
     : warm(false)
     , n(n_)
     , degree(degree_)
     , k(k_)
-    , Rgg()
-    , codes() {
-        if (k != 1)
-            throw new std::logic_error("Not implemented.");
+    , min_distance(0)
+    , canonical(false)
+    , table_path()
+    , table()
+    , fixed_distance(fixedDistanceFor(n_, degree_))
+    , incremental(!fixed_distance && IncrementalDistance::fits(n_, degree_))
+    , probes()
+    , probe_weights()
+    , key_bound()
+    , any_bound()
+    , join_memory(JOIN_MEMORY)
+    , join_ready(false)
+    , join()
+    , stats_lock()
+    , stats()
+    , prepare_lock()
+    , params_lock()
+    , control() {
+        if (k == 0 || 2 * k > n)
+            throw std::invalid_argument("A self-orthogonal code needs 1 <= k <= n / 2");
+        if (n > 64)
+            throw std::invalid_argument("n is too large");
+        if (2 * degree + 1 > PACKED_CAPACITY)
+            throw std::invalid_argument("Degree is too large");
     };
 
     size_t getN(){
@@ -41,29 +336,201 @@ public:
         return degree;
     }
 
+    xlong getMinDistance(){
+        return min_distance;
+    }
+
+    // Only codes with minDistance() >= d are returned, 0 returns all codes.
+    void setMinDistance(xlong d){
+        std::lock_guard<std::mutex> guard(params_lock);
+        checkIdle(d != min_distance);
+        min_distance = d;
+    }
+
+    bool getCanonical(){
+        return canonical;
+    }
+
+    // Returns one code per equivalence class (see canonical.h) instead
+    // of the codes passing order_check. Only for k = 1.
+    void setCanonical(bool c){
+        if (c && k != 1)
+            throw std::invalid_argument("Canonical search needs k = 1");
+        std::lock_guard<std::mutex> guard(params_lock);
+        checkIdle(c != canonical);
+        if (c != canonical)
+            join_ready = false;
+        canonical = c;
+    }
+
+    size_t getJoinMemory(){
+        return join_memory;
+    }
+
+    // Memory the meet-in-the-middle join of generate() may take, see
+    // prepareJoin(); 0 always runs the plain recursion.
+    void setJoinMemory(size_t bytes){
+        std::lock_guard<std::mutex> guard(params_lock);
+        checkIdle(bytes != join_memory);
+        if (bytes != join_memory)
+            join_ready = false;
+        join_memory = bytes;
+    }
+
+    std::string getTablePath(){
+        return table_path;
+    }
+
+    // File of the Rgg table (see RggTable::openOrBuild), an empty path
+    // builds the table in memory on every run.
+    void setTablePath(const std::string& path){
+        std::lock_guard<std::mutex> guard(params_lock);
+        checkIdle(path != table_path);
+        if (path != table_path)
+            warm = false;
+        table_path = path;
+    }
+
+    StatsCounts getStats(){
+        std::lock_guard<std::mutex> guard(stats_lock);
+        return stats;
+    }
+
+    void resetStats(){
+        std::lock_guard<std::mutex> guard(stats_lock);
+        stats.clear();
+    }
+
+    // Progress of the running or last call of find(), findShard() or
+    // next(); nodes and codes count from the start of the last find()
+    // or findShard() call.
+    SearchProgress getProgress(){
+        return SearchProgress{control.nodes, control.codes, control.tasks_done, control.tasks, control.running > 0};
+    }
+
+    // Stops the calls of this search running on other threads at their
+    // next PROGRESS_NODES nodes; they throw SearchCancelled. A call not
+    // yet started is not affected. A cancelled next() leaves its cursor
+    // at the first code it did not return, and a checkpointed find()
+    // saves its checkpoint before it throws.
+    void cancel(){
+        control.cancelled = true;
+    }
+
+    // Sets min_distance and canonical for the calls made while the object
+    // lives and counts as a running call, both in one step, so that no
+    // other thread changes them in between. Calls side by side on one
+    // search share its parameters: a Session asking for others than the
+    // running calls use throws std::logic_error, and searches with other
+    // parameters need their own SearchSelfOrthogonal.
+    class Session{
+        SearchSelfOrthogonal& search;
+    public:
+        Session(SearchSelfOrthogonal& search_, xlong min_distance, bool canonical): search(search_) {
+            if (canonical && search.k != 1)
+                throw std::invalid_argument("Canonical search needs k = 1");
+            std::lock_guard<std::mutex> guard(search.params_lock);
+            search.checkIdle(min_distance != search.min_distance || canonical != search.canonical);
+            if (canonical != search.canonical)
+                search.join_ready = false;
+            search.min_distance = min_distance;
+            search.canonical = canonical;
+            search.enter(false);
+        };
+        Session(const Session&) = delete;
+        Session& operator=(const Session&) = delete;
+        ~Session(){
+            --search.control.running;
+        };
+    };
+
+    // Number of series of every Rgg bucket, in key order.
+    std::vector<size_t> bucketSizes(){
+        initialize();
+        std::vector<size_t> sizes;
+        for (size_t j = 0; j < table->size(); ++j)
+            sizes.push_back(table->bucketSize(j));
+        return sizes;
+    }
+
+    // Adds the counters of a finished walk to this search and to the
+    // process-wide counters; Code records its own calls there already.
+    void record(SearchWalk& w){
+        w.poll();
+        if (!w.counting)
+            return;
+        w.counts[SEARCH_NS] += statsClock() - w.started;
+        GlobalStats::instance().add(w.counts, SEARCH_COUNTERS);
+        std::lock_guard<std::mutex> guard(stats_lock);
+        stats.add(w.counts);
+    }
+
     void initialize(){
+        std::lock_guard<std::mutex> guard(prepare_lock);
         if (warm) return;
-        std::vector<gf4> s(degree + 1);
-        s[0] = gf4(1);
-        for(;;){
-            Series series(s);
-            auto v = (series.inverse().conj() * series).strip();
-            auto search = Rgg.find(v);
-            if (search == Rgg.end()){
-                Rgg.insert({v, std::shared_ptr<std::vector<Series>>(new std::vector<Series>())});
-            }
-            search = Rgg.find(v);
-            search->second->push_back(series);
-            // find next series
-            bool carry = true;
-            for (int i = degree; i >= 0; --i)
-                if (carry){
-                    carry = ++s[i] == 0; 
+        uint64_t started = statsEnabled() ? statsClock() : 0;
+        if (table_path.empty())
+            table = std::make_shared<const RggTable>(RggTable::build(degree));
+        else
+            table = std::make_shared<const RggTable>(RggTable::openOrBuild(table_path, degree));
+        probes.clear();
+        join_ready = false;
+        warm = true;
+        if (started){
+            uint64_t t = statsClock() - started;
+            GlobalStats::instance().add(INITIALIZE_NS, t);
+            std::lock_guard<std::mutex> guard(stats_lock);
+            stats[INITIALIZE_NS] += t;
+        }
+    }
+
+    // A nonzero input x takes the trellis from state 0 back to state 0
+    // with output x * g in the column of generator g, so the lightest
+    // such path bounds the free distance from above. probe_weights[j]
+    // holds the output weight of every probe for every series of
+    // bucket j, key_bound the maximum over a bucket and any_bound the
+    // maximum over all series.
+    void prepareBounds(){
+        std::lock_guard<std::mutex> guard(prepare_lock);
+        if (!probes.empty()) return;
+        for (size_t size = 1; size <= PROBE_DEGREE + 1; ++size)
+            for (uint64_t lo = 0; lo < ((uint64_t)1 << size); lo += 2)
+                for (uint64_t hi = 0; hi < ((uint64_t)1 << size); hi += 2)
+                    if (((lo | hi) >> (size - 1)) & 1 || size == 1)
+                        probes.push_back(PackedSeries(lo | 1, hi, size, 0));
+        size_t P = probes.size();
+        size_t K = table->size();
+        probe_weights.assign(K, std::vector<int>());
+        key_bound.assign(K * P, 0);
+        any_bound.assign(P, 0);
+        for (size_t j = 0; j < K; ++j){
+            for (size_t i = 0; i < table->bucketSize(j); ++i){
+                PackedSeries packed = table->series(j, i);
+                for (size_t p = 0; p < P; ++p){
+                    int w = (probes[p] * packed).weight();
+                    probe_weights[j].push_back(w);
+                    key_bound[j * P + p] = std::max(key_bound[j * P + p], w);
+                    any_bound[p] = std::max(any_bound[p], w);
                 }
-            if (s[0] != 1)
-                break;
+            }
         }
-        warm = true;
+    }
+
+    // Adds `weights` to the bound of the previous level and checks that
+    // codes below can still reach min_distance when `rest` more columns
+    // are taken from `rest_bound` (nullptr for any column).
+    bool reachable(SearchWalk& w, size_t level, const int* weights, size_t rest, const int* rest_bound){
+        if (min_distance <= 0)
+            return true;
+        size_t P = probes.size();
+        int* acc = &w.bound[level * P];
+        bool ok = true;
+        for (size_t p = 0; p < P; ++p){
+            acc[p] = acc[p - P] + weights[p];
+            xlong upper = acc[p] + (rest_bound ? rest_bound[p] : (int)rest * any_bound[p]);
+            ok = ok && upper >= min_distance;
+        }
+        return ok;
     }
 
     bool order_check(Code& c){
@@ -88,50 +555,989 @@ public:
         return nonzero;
     }
 
-    void append(const std::vector<Series>& rgg, std::vector<Series>& code, size_t i){
+    // Series::operator< on two columns of one size with zero_shift 0:
+    // the lowest differing coefficient decides.
+    static bool columnLess(const PackedSeries& a, const PackedSeries& b){
+        uint64_t diff = (a.lo ^ b.lo) | (a.hi ^ b.hi);
+        if (diff == 0)
+            return false;
+        size_t i = __builtin_ctzll(diff);
+        return a.at(i).value < b.at(i).value;
+    }
+
+    // order_check() of the k = 1 code with the first n of these
+    // columns, without building it.
+    bool order_check(const std::vector<PackedSeries>& columns){
+        for (size_t j = 1; j < n; ++j)
+            if (!columnLess(columns[j - 1], columns[j]))
+                return false;
+        if (columnLess(columns[0].conj(), columns[0]))
+            return false;
+        for (size_t j = 0; j < n; ++j)
+            if (((columns[j].lo | columns[j].hi) >> degree) & 1)
+                return true;
+        return false;
+    }
+
+    // In canonical mode generate() takes keys in nondecreasing order and
+    // append() takes increasing series within a bucket, so columns come
+    // sorted by ColumnKey. Conjugation and reversal both conjugate every
+    // autocorrelation, so a key tuple whose conjugate sorts lower cannot
+    // lead to a canonical code.
+    bool canonical_keys(const std::vector<size_t>& v, SearchWalk& w){
+        std::vector<size_t>& conj = w.conj_keys;
+        conj.clear();
+        for (auto j: v)
+            conj.push_back(table->conj(j));
+        std::sort(conj.begin(), conj.end());
+        return !(conj < v);
+    }
+
+    bool canonical_check(SearchWalk& w){
+        bool nonzero = false;
+        for (auto& g: w.columns)
+            nonzero = nonzero || (((g.lo | g.hi) >> degree) & 1);
+        return nonzero && isCanonical(w.columns, degree + 1, w.own_keys, w.transformed_keys);
+    }
+
+    // The code of the first `rows` rows chosen so far; only leaves that
+    // pass the checks are turned into a Code.
+    Code leafCode(const SearchWalk& w, size_t rows){
+        std::vector<Series> generators;
+        generators.reserve(rows * n);
+        for (size_t j = 0; j < rows * n; ++j)
+            generators.push_back(Series(w.columns[j]));
+        return Code(generators, n, rows);
+    }
+
+    // Adds the code of the walk's columns to its output.
+    void emit(SearchWalk& w){
+        if (w.found == w.limit){
+            w.stopped = true;
+            return;
+        }
+        w.out->push_back(leafCode(w, k));
+        ++w.found;
+        w.count(CODES_FOUND);
+    }
+
+    // Autocorrelation of the columns [first, last) of a row, the sum of
+    // conj(g(1/D)) * g(D) over them. It is its own conjugate reversed, so
+    // lags 0..degree fix it; they are returned with the lo plane in the
+    // low degree + 1 bits and the hi plane above. Every column has size
+    // degree + 1, so all of them are taken times D^degree and the sum
+    // stays in one word.
+    uint64_t autocorrelationKey(const PackedSeries* row, size_t first, size_t last){
+        uint64_t lo = 0, hi = 0;
+        for (size_t c = first; c < last; ++c){
+            const PackedSeries& g = row[c];
+            uint64_t rlo = reverseBits(g.lo) >> (63 - degree), rhi = reverseBits(g.hi) >> (63 - degree);
+            uint64_t alo = rlo ^ rhi, ahi = rhi;
+            uint64_t p0 = clmul(alo, g.lo), p2 = clmul(ahi, g.hi), p1 = clmul(alo ^ ahi, g.lo ^ g.hi);
+            lo ^= p0 ^ p2;
+            hi ^= p1 ^ p0;
+        }
+        uint64_t mask = ((uint64_t)1 << (degree + 1)) - 1;
+        return ((lo >> degree) & mask) | (((hi >> degree) & mask) << (degree + 1));
+    }
+
+    // Reduces the constant coefficients (lo, hi) of a row by the rows of
+    // `reduced`, each a row with 1 at its pivot column, and adds what is
+    // left to them; false if nothing is left.
+    static bool addConstants(std::vector<std::array<uint64_t, 3>>& reduced, uint64_t lo, uint64_t hi){
+        for (auto& r: reduced){
+            uint64_t clo = -((lo >> r[2]) & 1), chi = -((hi >> r[2]) & 1);
+            uint64_t plo, phi;
+            mulPlanes(r[0], r[1], clo, chi, plo, phi);
+            lo ^= plo;
+            hi ^= phi;
+        }
+        if ((lo | hi) == 0)
+            return false;
+        uint64_t pivot = __builtin_ctzll(lo | hi);
+        gf4 c((char)(((lo >> pivot) & 1) | (((hi >> pivot) & 1) << 1)));
+        c = c.conj();
+        mulPlanes(lo, hi, -(uint64_t)(c.value & 1), -(uint64_t)(c.value >> 1), lo, hi);
+        reduced.push_back({lo, hi, pivot});
+        return true;
+    }
+
+    // Adds the constant coefficients of `row` to w.constant_rows, see
+    // addConstants().
+    bool addRowConstants(SearchWalk& w, const PackedSeries* row){
+        uint64_t lo = 0, hi = 0;
+        for (size_t c = 0; c < n; ++c){
+            lo |= (row[c].lo & 1) << c;
+            hi |= (row[c].hi & 1) << c;
+        }
+        return addConstants(w.constant_rows, lo, hi);
+    }
+
+    // Sets w.rows[i] to the rows orthogonal to rows 0..i-1, coefficient t
+    // of column c being unknown c * (degree + 1) + t as in
+    // Code::findOrthogonal(). Adding a combination of earlier rows times
+    // powers of D to row i gives the same code and keeps it orthogonal
+    // and self-orthogonal, so the row is also zero at the pivots of those
+    // combinations in reduced echelon form: one row of every such class
+    // is left, and every code is met once per choice of the rows above
+    // it. The rows zero on columns [n / 2, n) give the left vectors, the
+    // rows zero on [0, n / 2) the right ones, and outer vectors complete
+    // them to a basis. Right vectors past ROW_JOIN_DIGITS count as outer
+    // ones, so that the table of prepareRight() stays small.
+    void prepareRow(size_t i, SearchWalk& w){
+        size_t width = degree + 1, N = n * width, E = 2 * degree + 1, half = n / 2;
+        std::vector<std::vector<gf4>> shifts;
+        for (size_t r = 0; r < i; ++r){
+            size_t top = 0;
+            for (size_t c = 0; c < n; ++c){
+                uint64_t nz = w.columns[r * n + c].lo | w.columns[r * n + c].hi;
+                if (nz)
+                    top = std::max(top, (size_t)(63 - __builtin_clzll(nz)));
+            }
+            for (size_t t = 0; t + top <= degree; ++t){
+                std::vector<gf4> x(N);
+                for (size_t c = 0; c < n; ++c)
+                    for (size_t ii = 0; ii + t < width; ++ii)
+                        x[c * width + ii + t] = w.columns[r * n + c].at(ii);
+                shifts.push_back(x);
+            }
+        }
+        PackedMatrix echelon(shifts.size(), N);
+        for (size_t v = 0; v < shifts.size(); ++v)
+            for (size_t z = 0; z < N; ++z)
+                echelon.set(v, z, shifts[v][z]);
+        std::vector<size_t> pivots = echelon.rowEchelon(true);
+
+        // rows orthogonal to the rows above, zero at the pivots and on
+        // the columns [zero_from, zero_to)
+        auto solve = [&](size_t zero_from, size_t zero_to){
+            size_t zeros = (zero_to - zero_from) * width;
+            PackedMatrix system(i * E + pivots.size() + zeros, N);
+            for (size_t r = 0; r < i; ++r)
+                for (size_t c = 0; c < n; ++c){
+                    const PackedSeries& g = w.columns[r * n + c];
+                    for (size_t ii = 0; ii <= degree; ++ii)
+                        for (size_t jj = 0; jj < width; ++jj)
+                            system.set(r * E + degree - ii + jj, c * width + jj, g.at(ii).conj());
+                }
+            for (size_t p = 0; p < pivots.size(); ++p)
+                system.set(i * E + p, pivots[p], 1);
+            for (size_t z = 0; z < zeros; ++z)
+                system.set(i * E + pivots.size() + z, zero_from * width + z, 1);
+            return system.nullspace();
+        };
+        std::vector<std::vector<gf4>> all = solve(0, 0), left = solve(half, n), right = solve(0, half);
+        std::vector<std::vector<gf4>> outer(right.begin() + std::min(right.size(), ROW_JOIN_DIGITS), right.end());
+        right.resize(right.size() - outer.size());
+
+        PackedMatrix span(0, N);
+        auto grows = [&](const std::vector<gf4>& x){
+            PackedMatrix grown(span.rows + 1, N);
+            std::copy(span.lo.begin(), span.lo.end(), grown.lo.begin());
+            std::copy(span.hi.begin(), span.hi.end(), grown.hi.begin());
+            for (size_t z = 0; z < N; ++z)
+                grown.set(span.rows, z, x[z]);
+            if (grown.rank() == span.rows)
+                return false;
+            span = grown;
+            return true;
+        };
+        for (auto* part: {&left, &right, &outer})
+            for (auto& x: *part)
+                grows(x);
+        for (auto& x: all)
+            if (grows(x))
+                outer.push_back(x);
+
+        RowSplit& split = w.rows[i];
+        split.outer = outer.size();
+        split.left = left.size();
+        split.right = right.size();
+        split.basis.clear();
+        for (auto* part: {&outer, &left, &right})
+            for (auto& x: *part)
+                for (size_t c = 0; c < n; ++c){
+                    uint64_t lo = 0, hi = 0;
+                    for (size_t t = 0; t < width; ++t){
+                        lo |= (uint64_t)(x[c * width + t].value & 1) << t;
+                        hi |= (uint64_t)(x[c * width + t].value >> 1) << t;
+                    }
+                    split.basis.push_back(PackedSeries(lo, hi, width, 0));
+                }
+    }
+
+    // Adds d times basis vector t of `split` to the columns [first, last)
+    // of a row, stored from `columns` on.
+    void addDigit(const RowSplit& split, size_t t, uint64_t d, PackedSeries* columns, size_t first, size_t last){
+        const PackedSeries* v = &split.basis[t * n];
+        for (size_t c = first; c < last; ++c){
+            uint64_t plo, phi;
+            mulPlanes(v[c].lo, v[c].hi, -(d & 1), -(d >> 1), plo, phi);
+            columns[c - first].lo ^= plo;
+            columns[c - first].hi ^= phi;
+        }
+    }
+
+    // Bucket of an autocorrelation key in a table of 2^bits buckets.
+    static size_t rowBucket(uint64_t key, size_t bits){
+        return (size_t)((key * 0x9E3779B97F4A7C15ULL) >> (64 - bits));
+    }
+
+    // Table of the right halves of row i for the outer digits chosen so
+    // far: every combination of the right vectors added to columns
+    // [n / 2, n) of the row, with the autocorrelation key of those
+    // columns, bucketed by key in combination order. Combination m has
+    // digit (m >> 2t) & 3 at right vector t.
+    void prepareRight(size_t i, SearchWalk& w){
+        RowSplit& s = w.rows[i];
+        size_t half = n / 2, first = s.outer + s.left, count = (size_t)1 << (2 * s.right), bits = 2 * s.right + 1;
+        const PackedSeries* row = &w.columns[i * n];
+        s.base.assign(row + half, row + n);
+        s.current = s.base;
+        s.unsorted.resize(count);
+        uint64_t at = 0;
+        for (uint64_t m = 0; m < count; ++m){
+            for (uint64_t delta = at ^ m; delta != 0;){
+                size_t t = __builtin_ctzll(delta) / 2;
+                addDigit(s, first + t, (delta >> (2 * t)) & 3, s.current.data(), half, n);
+                delta &= ~((uint64_t)3 << (2 * t));
+            }
+            at = m;
+            s.unsorted[m] = autocorrelationKey(s.current.data(), 0, n - half);
+        }
+        s.offsets.assign(((size_t)1 << bits) + 1, 0);
+        for (uint64_t m = 0; m < count; ++m)
+            ++s.offsets[rowBucket(s.unsorted[m], bits) + 1];
+        for (size_t b = 1; b < s.offsets.size(); ++b)
+            s.offsets[b] += s.offsets[b - 1];
+        s.keys.resize(count);
+        s.combos.resize(count);
+        s.fill.assign(s.offsets.begin(), s.offsets.end() - 1);
+        for (uint64_t m = 0; m < count; ++m){
+            size_t e = s.fill[rowBucket(s.unsorted[m], bits)]++;
+            s.keys[e] = s.unsorted[m];
+            s.combos[e] = m;
+        }
+    }
+
+    // Row i > 0 of a k > 1 code. Row 0 comes from the k = 1 search, the
+    // others grow one basis vector of w.rows[i] at a time (see
+    // prepareRow()): a digit for every outer vector, then one for every
+    // left vector, the first nonzero digit being 1 as the other units
+    // give the same code. The two halves of a row add up their
+    // autocorrelations, so the row is self-orthogonal when their keys are
+    // equal: with the outer digits fixed, the right halves that complete
+    // the left one are looked up in the table of prepareRight(), as
+    // generate() looks up its last key. A row is kept if the constant
+    // coefficients of the rows stay independent, so the encoder is
+    // delay-free and of full rank. The row is a codeword itself, and the
+    // code of the rows so far contains no more codewords than the whole
+    // code, so both prune like the bounds of prepareBounds().
+    void extendRows(size_t i, SearchWalk& w){
+        prepareRow(i, w);
+        PackedSeries* row = &w.columns[i * n];
+        for (size_t c = 0; c < n; ++c)
+            row[c] = PackedSeries(0, 0, degree + 1, 0);
+        extendDigits(i, 0, true, w);
+    }
+
+    // Digit t of row i; `leading` while every digit before it is 0.
+    void extendDigits(size_t i, size_t t, bool leading, SearchWalk& w){
+        const RowSplit& s = w.rows[i];
+        if (t == s.outer)
+            prepareRight(i, w);
+        if (t == s.outer + s.left){
+            matchRight(i, leading, w);
+            return;
+        }
+        PackedSeries* row = &w.columns[i * n];
+        size_t last = t < s.outer ? n : n / 2;
+        for (size_t d = w.start(w.path.size()); d < (leading ? 2 : GF4_SIZE); ++d){
+            if (!w.budget(d))
+                return;
+            w.count(ROW_NODES);
+            addDigit(s, t, d, row, 0, last);
+            w.path.push_back(d);
+            extendDigits(i, t + 1, leading && d == 0, w);
+            addDigit(s, t, d, row, 0, last);
+            w.resume = false;
+            if (w.stopped)
+                return;
+            w.path.pop_back();
+        }
+    }
+
+    // Last level of row i: the right halves whose key equals that of the
+    // left half, in the order of their bucket.
+    void matchRight(size_t i, bool leading, SearchWalk& w){
+        const RowSplit& s = w.rows[i];
+        size_t half = n / 2, first = s.outer + s.left;
+        PackedSeries* row = &w.columns[i * n];
+        uint64_t key = autocorrelationKey(row, 0, half);
+        size_t b = rowBucket(key, 2 * s.right + 1), from = s.offsets[b], size = s.offsets[b + 1] - from;
+        size_t reduced = w.constant_rows.size();
+        for (size_t j = w.start(w.path.size()); j < size; ++j){
+            uint64_t m = s.combos[from + j];
+            if (s.keys[from + j] != key || (leading && (m == 0 || ((m >> (__builtin_ctzll(m) & ~1)) & 3) != 1)))
+                continue;
+            if (!w.budget(j))
+                return;
+            w.count(ROW_NODES);
+            std::copy(s.base.begin(), s.base.end(), row + half);
+            for (uint64_t rest = m; rest != 0;){
+                size_t t = __builtin_ctzll(rest) / 2;
+                addDigit(s, first + t, (rest >> (2 * t)) & 3, row + half, half, n);
+                rest &= ~((uint64_t)3 << (2 * t));
+            }
+            bool ok = addRowConstants(w, row);
+            w.constant_rows.resize(reduced);
+            if (ok && min_distance > 0){
+                xlong weight = 0;
+                for (size_t c = 0; c < n; ++c)
+                    weight += row[c].weight();
+                uint64_t started = w.counting ? statsClock() : 0;
+                ok = weight >= min_distance && leafCode(w, i + 1).hasDistanceAtLeast(min_distance);
+                if (w.counting){
+                    w.counts[MIN_DISTANCE_NS] += statsClock() - started;
+                    w.counts[MIN_DISTANCE_CALLS] += 1;
+                    if (!ok)
+                        w.counts[DISTANCE_REJECTED] += 1;
+                }
+            }
+            if (!ok){
+                w.count(ROW_REJECTED);
+                w.resume = false;
+                continue;
+            }
+            w.path.push_back(j);
+            if (i + 1 < k){
+                addRowConstants(w, row);
+                extendRows(i + 1, w);
+                w.constant_rows.resize(reduced);
+            } else
+                emit(w);
+            w.resume = false;
+            if (w.stopped)
+                return;
+            w.path.pop_back();
+        }
+        // the outer digits are taken off the base again
+        std::copy(s.base.begin(), s.base.end(), row + half);
+    }
+
+    void append(const std::vector<size_t>& rgg, size_t i, SearchWalk& w){
         if (i == n) {
-            Code c(code, n, k);
-            if (order_check(c)){
-                codes.push_back(c);
+            w.count(LEAVES);
+            uint64_t started = w.counting ? statsClock() : 0;
+            bool ok = canonical ? canonical_check(w) : order_check(w.columns);
+            if (w.counting){
+                w.counts[ORDER_CHECK_NS] += statsClock() - started;
+                if (!ok)
+                    w.counts[canonical ? CANONICAL_REJECTED : ORDER_CHECK_REJECTED] += 1;
             }
+            if (ok && min_distance > 0){
+                started = w.counting ? statsClock() : 0;
+                if (incremental)
+                    ok = w.distance.minDistance(min_distance) >= min_distance;
+                else if (fixed_distance)
+                    ok = fixed_distance(w.columns.data(), min_distance) >= min_distance;
+                else
+                    ok = leafCode(w, 1).hasDistanceAtLeast(min_distance);
+                if (w.counting){
+                    w.counts[MIN_DISTANCE_NS] += statsClock() - started;
+                    w.counts[MIN_DISTANCE_CALLS] += 1;
+                    if (!ok)
+                        w.counts[DISTANCE_REJECTED] += 1;
+                }
+            }
+            if (ok && k > 1){
+                w.constant_rows.clear();
+                addRowConstants(w, &w.columns[0]);
+                extendRows(1, w);
+            } else if (ok)
+                emit(w);
         } else {
-            auto v = Rgg.find(rgg[i])->second;
-            for (auto it = v->begin(); it != v->end(); ++it){
-                code.push_back(*it);
-                append(rgg, code, i + 1);
-                code.pop_back();
+            size_t size = table->bucketSize(rgg[i]);
+            size_t P = probes.size();
+            size_t first = w.start(n - 1 + i);
+            if (canonical && i > 0 && rgg[i] == rgg[i - 1])
+                first = std::max(first, w.path.back() + 1);
+            for (size_t j = first; j < size; ++j){
+                if (!w.budget(j))
+                    return;
+                w.count(APPEND_NODES);
+                if (!reachable(w, n + 1 + i, min_distance > 0 ? &probe_weights[rgg[i]][j * P] : nullptr,
+                               0, min_distance > 0 ? &w.suffix[(i + 1) * P] : nullptr)){
+                    w.count(BOUND_PRUNED);
+                    w.resume = false;
+                    continue;
+                }
+                w.columns[i] = table->series(rgg[i], j);
+                if (incremental)
+                    w.distance.setColumn(i, w.columns[i]);
+                w.path.push_back(j);
+                append(rgg, i + 1, w);
+                w.resume = false;
+                if (w.stopped)
+                    return;
+                w.path.pop_back();
             }
         }
     }
 
-    void generate(std::vector<Series>& v, const Series& s, size_t i){
-        if (i == n - 1){
-            auto search = Rgg.find(s);
-            if (search != Rgg.end()){
-                v.push_back(s);
-                std::vector<Series> code;
-                code.reserve(n);
-                append(v, code, 0);
-                v.pop_back();
+    // Last key of generate(): the key tuple v, key is complete.
+    void complete(std::vector<size_t>& v, size_t key, SearchWalk& w){
+        w.count(GENERATE_HITS);
+        v.push_back(key);
+        if (canonical && !canonical_keys(v, w)){
+            w.count(CANONICAL_REJECTED);
+            v.pop_back();
+            return;
+        }
+        if (min_distance > 0){
+            size_t P = probes.size();
+            w.suffix.assign((n + 1) * P, 0);
+            for (size_t c = n; c-- > 0;)
+                for (size_t p = 0; p < P; ++p)
+                    w.suffix[c * P + p] = w.suffix[(c + 1) * P + p] + key_bound[v[c] * P + p];
+        }
+        if (reachable(w, n, min_distance > 0 ? &key_bound[key * probes.size()] : nullptr, 0, nullptr))
+            append(v, 0, w);
+        else
+            w.count(BOUND_PRUNED);
+        v.pop_back();
+    }
+
+    // Number of key tuples of a given length, nondecreasing ones in
+    // canonical mode; SIZE_MAX if it does not fit.
+    size_t tupleCount(size_t levels){
+        size_t K = table->size(), count = 1;
+        for (size_t l = 0; l < levels; ++l){
+            // canonical: multisets, C(K + l, l + 1) built up one factor at a time
+            size_t f = canonical ? K + l : K;
+            if (count > SIZE_MAX / f)
+                return SIZE_MAX;
+            count = canonical ? count * f / (l + 1) : count * f;
+        }
+        return count;
+    }
+
+    // Groups the key tuples of the last levels of generate() by sum, so
+    // that generate() stops after n - levels levels and looks the rest
+    // up: |Rgg|^(n - levels) lookups instead of |Rgg|^(n - 1). The most
+    // levels up to n / 2 whose tuples fit in join_memory are taken;
+    // with fewer than two levels there is nothing to gain and generate()
+    // runs the plain recursion.
+    void prepareJoin(){
+        std::lock_guard<std::mutex> guard(prepare_lock);
+        if (join_ready)
+            return;
+        join_ready = true;
+        join.reset();
+        size_t K = table->size(), m = n / 2;
+        for (; m >= 2; --m){
+            size_t count = tupleCount(m);
+            if (count != SIZE_MAX && count <= join_memory / (sizeof(uint32_t) * m + 2 * sizeof(PackedSeries)))
+                break;
+        }
+        if (m < 2 || K > UINT32_MAX)
+            return;
+
+        auto j = std::make_shared<SuffixJoin>();
+        j->levels = m;
+        // two passes over the tuples in generate() order: sizes of the
+        // groups, then the tuples themselves
+        std::vector<uint32_t> t(m);
+        std::vector<PackedSeries> sums(m + 1);
+        for (int pass = 0; pass < 2; ++pass){
+            if (pass == 1){
+                size_t total = 0;
+                for (auto& g: j->groups){
+                    g.second.first = total;
+                    total += g.second.second;
+                    g.second.second = g.second.first;
+                }
+                j->tuples.resize(total * m);
+            }
+            std::fill(t.begin(), t.end(), 0);
+            for (size_t l = 0; l < m; ++l)
+                sums[l + 1] = sums[l] + table->key(0);
+            while (true){
+                auto& g = j->groups[sums[m]];
+                if (pass == 0)
+                    ++g.second;
+                else
+                    std::copy(t.begin(), t.end(), &j->tuples[m * g.second++]);
+                // next tuple: the last level that can still grow moves on,
+                // the levels after it restart
+                size_t l = m;
+                while (l > 0 && t[l - 1] + 1 == K)
+                    --l;
+                if (l == 0)
+                    break;
+                ++t[l - 1];
+                sums[l] = sums[l - 1] + table->key(t[l - 1]);
+                for (; l < m; ++l){
+                    t[l] = canonical ? t[l - 1] : 0;
+                    sums[l + 1] = sums[l] + table->key(t[l]);
+                }
+            }
+        }
+        // groups now hold [first, end) of their tuples
+        join = j;
+    }
+
+    // The last join->levels levels of generate() for the prefix v with
+    // key sum s: the tuples of group s, with the checks generate() does
+    // at those levels.
+    void joinSuffixes(std::vector<size_t>& v, const PackedSeries& s, SearchWalk& w){
+        w.count(GENERATE_LOOKUPS);
+        auto it = join->groups.find(s);
+        if (it == join->groups.end())
+            return;
+        size_t m = join->levels, h = n - m;
+        if (w.resume && w.from.size() <= h)
+            w.resume = false;
+        for (size_t e = it->second.first; e < it->second.second; ++e){
+            const uint32_t* t = &join->tuples[e * m];
+            if (canonical && h > 0 && t[0] < v[h - 1])
+                continue;
+            if (w.resume){
+                size_t len = std::min(w.from.size(), n - 1) - h;
+                int cmp = 0;
+                for (size_t l = 0; l < len && cmp == 0; ++l)
+                    cmp = t[l] < w.from[h + l] ? -1 : t[l] > w.from[h + l] ? 1 : 0;
+                if (cmp < 0)
+                    continue;
+                if (cmp > 0)
+                    w.resume = false;
+            }
+            if (!w.budget(t, m - 1))
+                return;
+            w.count(GENERATE_NODES);
+            bool ok = true;
+            for (size_t l = 0; l + 1 < m && ok; ++l)
+                ok = reachable(w, h + l + 1, min_distance > 0 ? &key_bound[t[l] * probes.size()] : nullptr, m - l - 1, nullptr);
+            if (!ok){
+                w.count(BOUND_PRUNED);
+                w.resume = false;
+                continue;
             }
+            for (size_t l = 0; l + 1 < m; ++l){
+                v.push_back(t[l]);
+                w.path.push_back(t[l]);
+            }
+            complete(v, t[m - 1], w);
+            v.resize(h);
+            w.resume = false;
+            if (w.stopped)
+                return;
+            w.path.resize(h);
+        }
+    }
+
+    void generate(std::vector<size_t>& v, const PackedSeries& s, size_t i, SearchWalk& w){
+        if (join && i == n - join->levels){
+            joinSuffixes(v, s, w);
+        } else if (i == n - 1){
+            w.count(GENERATE_LOOKUPS);
+            size_t key = table->find(s);
+            if (key != table->size() && (!canonical || v.empty() || key >= v.back()))
+                complete(v, key, w);
         } else {
-            for (auto it = Rgg.begin(); it != Rgg.end(); ++it){
-                v.push_back(it->first);
-                generate(v, s + it->first, i + 1);
+            size_t first = w.start(i);
+            if (canonical && i > 0)
+                first = std::max(first, v[i - 1]);
+            for (size_t j = first; j < table->size(); ++j){
+                if (!w.budget(j))
+                    return;
+                w.count(GENERATE_NODES);
+                if (!reachable(w, i + 1, min_distance > 0 ? &key_bound[j * probes.size()] : nullptr, n - i - 1, nullptr)){
+                    w.count(BOUND_PRUNED);
+                    w.resume = false;
+                    continue;
+                }
+                v.push_back(j);
+                w.path.push_back(j);
+                generate(v, s + table->key(j), i + 1, w);
                 v.pop_back();
+                w.resume = false;
+                if (w.stopped)
+                    return;
+                w.path.pop_back();
             }
         }
     }
 
-    std::vector<Code> find(){
+    // Sets up the walk before the first level of generate().
+    void begin(SearchWalk& w){
         initialize();
-        std::vector<Series> v;
+        prepareJoin();
+        w.columns.assign(k * n, PackedSeries(0, 0, degree + 1, 0));
+        w.rows.resize(k);
+        w.path.reserve(2 * n + k);
+        w.control = &control;
+        if (min_distance > 0){
+            prepareBounds();
+            w.bound.assign((2 * n + 1) * probes.size(), 0);
+        }
+        if (incremental)
+            w.distance = IncrementalDistance(n, degree);
+    }
+
+    // A task fixes the keys of the first `depth` levels of generate(),
+    // task numbers follow the order in which generate() visits them. The
+    // depth is the first to give at least `tasks` tasks, if any does.
+    size_t taskDepth(size_t tasks, size_t& count){
+        size_t depth = 0;
+        count = 1;
+        while (depth + 1 < n && count < tasks){
+            count *= table->size();
+            ++depth;
+        }
+        return depth;
+    }
+
+    // Keys of task `task` of the first `depth` levels.
+    std::vector<size_t> taskPath(size_t task, size_t depth){
+        std::vector<size_t> path(depth);
+        for (size_t i = depth; i-- > 0;){
+            path[i] = task % table->size();
+            task /= table->size();
+        }
+        return path;
+    }
+
+    void runTask(size_t task, size_t depth, std::vector<Code>& out){
+        if (control.cancelled)
+            return;
+        std::vector<size_t> path = taskPath(task, depth);
+        SearchWalk w(&out);
+        begin(w);
+        PackedSeries s;
+        bool ok = true;
+        for (size_t i = 0; i < depth && ok; ++i){
+            ok = !(canonical && i > 0 && path[i] < path[i - 1])
+                && reachable(w, i + 1, min_distance > 0 ? &key_bound[path[i] * probes.size()] : nullptr, n - i - 1, nullptr);
+            s = s + table->key(path[i]);
+        }
+        if (ok){
+            w.path = path;
+            generate(path, s, depth, w);
+        }
+        record(w);
+    }
+
+    // Appends at most `limit` further codes to `out`, resuming at
+    // `cursor`, and moves the cursor to the first code not returned. The
+    // walk also stops after visiting `node_limit` nodes.
+    size_t next(SearchCursor& cursor, std::vector<Code>& out, size_t limit, size_t node_limit = SIZE_MAX){
+        if (cursor.done || limit == 0)
+            return 0;
+        Running running(*this, false);
+        SearchWalk w(&out, limit, node_limit);
+        begin(w);
+        w.from = cursor.position;
+        w.resume = true;
+        std::vector<size_t> v;
         v.reserve(n);
-        Series s;
-        generate(v, s, 0);
+        PackedSeries s;
+        generate(v, s, 0, w);
+        record(w);
+        if (w.stopped)
+            cursor.position = w.path;
+        else
+            cursor.done = true;
+        checkCancelled();
+        return w.found;
+    }
+
+    // Streams the results of find() to `visitor` in batches of at most
+    // `batch` codes; the search stops early once visitor returns false.
+    void find(const std::function<bool(std::vector<Code>&)>& visitor, size_t batch = 1024){
+        Running running(*this, true);
+        SearchCursor cursor;
+        std::vector<Code> codes;
+        codes.reserve(batch);
+        while (next(cursor, codes, batch) > 0){
+            if (!visitor(codes))
+                return;
+            codes.clear();
+        }
+    }
+
+    // Search parameters and codes as saved by saveCheckpoint() and
+    // findShard(), one code per line.
+    void writeParameters(std::ostream& out){
+        out << n << " " << degree << " " << k << " " << min_distance << " " << canonical << "\n";
+    }
+
+    void readParameters(std::istream& in, const std::string& path){
+        size_t n_, degree_, k_;
+        xlong min_distance_;
+        bool canonical_;
+        in >> n_ >> degree_ >> k_ >> min_distance_ >> canonical_;
+        if (!in)
+            throw std::runtime_error("Corrupted search file: " + path);
+        if (n_ != n || degree_ != degree || k_ != k || min_distance_ != min_distance || canonical_ != canonical)
+            throw std::invalid_argument(path + " is of another search");
+    }
+
+    void writeCodes(std::ostream& out, std::vector<Code>& codes){
+        out << codes.size() << "\n";
+        for (auto& c: codes)
+            out << c.toString() << "\n";
+    }
+
+    void readCodes(std::istream& in, std::vector<Code>& codes){
+        size_t count = 0;
+        in >> count;
+        codes.clear();
+        codes.reserve(count);
+        std::string line;
+        for (size_t i = 0; i < count && in >> line; ++i){
+            std::vector<Series> generators;
+            std::stringstream tokens(line);
+            std::string g;
+            while (std::getline(tokens, g, '|'))
+                if (!g.empty())
+                    generators.push_back(Series(g));
+            codes.push_back(Code(generators, n, generators.size() / n));
+        }
+    }
+
+    // Writes the cursor and the codes found so far to `path`, replacing
+    // the file only once the new one is complete.
+    void saveCheckpoint(const std::string& path, const SearchCursor& cursor, std::vector<Code>& codes){
+        std::string tmp = path + ".tmp";
+        {
+            std::ofstream out(tmp, std::ios::trunc);
+            out << "cppcodes-checkpoint 1\n";
+            writeParameters(out);
+            out << cursor.done << " " << cursor.position.size();
+            for (auto x: cursor.position)
+                out << " " << x;
+            out << "\n";
+            writeCodes(out, codes);
+            out.close();
+            if (!out)
+                throw std::runtime_error("Cannot write " + tmp);
+        }
+        if (std::rename(tmp.c_str(), path.c_str()) != 0)
+            throw std::runtime_error("Cannot write " + path);
+    }
+
+    // Reads a file written by saveCheckpoint(), returns false if there is none.
+    bool loadCheckpoint(const std::string& path, SearchCursor& cursor, std::vector<Code>& codes){
+        std::ifstream in(path);
+        if (!in)
+            return false;
+        std::string magic;
+        size_t version, length;
+        in >> magic >> version;
+        if (!in || magic != "cppcodes-checkpoint" || version != 1)
+            throw std::runtime_error("Not a search checkpoint: " + path);
+        readParameters(in, path);
+        in >> cursor.done >> length;
+        cursor.position.resize(length);
+        for (auto& x: cursor.position)
+            in >> x;
+        readCodes(in, codes);
+        if (!in)
+            throw std::runtime_error("Truncated search checkpoint: " + path);
+        return true;
+    }
+
+    // Serial find() that saves its progress to `path` every `seconds`
+    // seconds or every `nodes` nodes, 0 turning either off, and resumes
+    // from `path` if it exists. The finished search leaves the complete
+    // result in the file, so a rerun returns it at once.
+    std::vector<Code> find(const std::string& path, double seconds, size_t nodes = 0){
+        Running running(*this, true);
+        SearchCursor cursor;
+        std::vector<Code> codes;
+        loadCheckpoint(path, cursor, codes);
+        auto last = std::chrono::steady_clock::now();
+        size_t since = 0;
+        while (!cursor.done){
+            size_t slice = CHECKPOINT_SLICE;
+            if (nodes > 0)
+                slice = std::min(slice, nodes - since);
+            try{
+                next(cursor, codes, SIZE_MAX, slice);
+            } catch (const SearchCancelled&){
+                saveCheckpoint(path, cursor, codes);
+                throw;
+            }
+            since += slice;
+            auto now = std::chrono::steady_clock::now();
+            if ((nodes > 0 && since >= nodes) || (seconds > 0 && std::chrono::duration<double>(now - last).count() >= seconds)){
+                saveCheckpoint(path, cursor, codes);
+                since = 0;
+                last = now;
+            }
+        }
+        saveCheckpoint(path, cursor, codes);
+        return codes;
+    }
+
+    std::vector<Code> find(size_t threads = 1){
+        Running running(*this, true);
+        std::vector<Code> codes;
+        if (threads == 1){
+            SearchWalk w(&codes);
+            begin(w);
+            std::vector<size_t> v;
+            v.reserve(n);
+            PackedSeries s;
+            generate(v, s, 0, w);
+            record(w);
+            checkCancelled();
+            return codes;
+        }
+
+        initialize();
+        size_t count;
+        size_t depth = taskDepth(TASKS_PER_THREAD * workerCount(threads, SIZE_MAX), count);
+        runTasks(depth, 0, count, threads, codes);
+        return codes;
+    }
+
+    // Runs tasks [first, last) of the first `depth` levels on `threads`
+    // threads and appends their codes to `codes` in task order.
+    void runTasks(size_t depth, size_t first, size_t last, size_t threads, std::vector<Code>& codes){
+        prepareJoin();
+        if (min_distance > 0)
+            prepareBounds();
+        threads = workerCount(threads, last - first);
+        control.tasks += last - first;
+        std::vector<std::vector<std::pair<size_t, std::vector<Code>>>> buffers(threads);
+        parallelFor(last - first, threads, [&](size_t i, size_t worker){
+            std::vector<Code> out;
+            runTask(first + i, depth, out);
+            ++control.tasks_done;
+            if (!out.empty())
+                buffers[worker].emplace_back(first + i, std::move(out));
+        });
+        checkCancelled();
+
+        std::vector<std::pair<size_t, std::vector<Code>>*> results;
+        for (auto& buffer: buffers)
+            for (auto& r: buffer)
+                results.push_back(&r);
+        std::sort(results.begin(), results.end(), [](
+            const std::pair<size_t, std::vector<Code>>* a,
+            const std::pair<size_t, std::vector<Code>>* b){ return a->first < b->first; });
+        for (auto r: results)
+            for (auto& c: r->second)
+                codes.push_back(std::move(c));
+    }
+
+    // Tasks [first, last) of the first `depth` levels that make up shard
+    // `index` of `count`. Shards are runs of consecutive tasks, cut where
+    // the estimated sizes of their subtrees add up to equal parts. A
+    // subtree is estimated by the number of series its keys stand for
+    // times that of the keys the free levels below may take: all of them,
+    // or in canonical mode those from the last key on. The split depends
+    // only on the search parameters and `count`.
+    std::pair<size_t, size_t> shardTasks(size_t index, size_t count, size_t& depth){
+        if (index >= count)
+            throw std::invalid_argument("Shard index is out of range");
+        initialize();
+        size_t tasks;
+        depth = taskDepth(TASKS_PER_SHARD * count, tasks);
+        // series of the keys from j on
+        std::vector<double> from(table->size() + 1, 0.0);
+        for (size_t j = table->size(); j-- > 0;)
+            from[j] = from[j + 1] + table->bucketSize(j);
+        std::vector<double> before(tasks + 1, 0.0);
+        for (size_t t = 0; t < tasks; ++t){
+            std::vector<size_t> path = taskPath(t, depth);
+            double size = std::pow(from[canonical && depth > 0 ? path[depth - 1] : 0], (double)(n - depth - 1));
+            for (size_t i = 0; i < depth; ++i)
+                size *= (canonical && i > 0 && path[i] < path[i - 1]) ? 0 : table->bucketSize(path[i]);
+            before[t + 1] = before[t] + size;
+        }
+        auto cut = [&](size_t shard){
+            if (shard == count)
+                return tasks;
+            return (size_t)(std::lower_bound(before.begin(), before.end(), before[tasks] * shard / count) - before.begin());
+        };
+        return std::make_pair(cut(index), cut(index + 1));
+    }
+
+    // Codes of shard `index` of `count`, in the order find() returns
+    // them; the shards in index order give exactly the codes of find().
+    std::vector<Code> findShard(size_t index, size_t count, size_t threads = 1){
+        Running running(*this, true);
+        size_t depth;
+        std::pair<size_t, size_t> range = shardTasks(index, count, depth);
+        std::vector<Code> codes;
+        runTasks(depth, range.first, range.second, threads, codes);
+        return codes;
+    }
+
+    // Runs shard `index` of `count` and writes its codes to `path`.
+    std::vector<Code> findShard(size_t index, size_t count, size_t threads, const std::string& path){
+        std::vector<Code> codes = findShard(index, count, threads);
+        std::string tmp = path + ".tmp";
+        {
+            std::ofstream out(tmp, std::ios::trunc);
+            out << "cppcodes-shard 1\n";
+            writeParameters(out);
+            out << index << " " << count << "\n";
+            writeCodes(out, codes);
+            out.close();
+            if (!out)
+                throw std::runtime_error("Cannot write " + tmp);
+        }
+        if (std::rename(tmp.c_str(), path.c_str()) != 0)
+            throw std::runtime_error("Cannot write " + path);
+        return codes;
+    }
+
+    // Codes of the shard files `paths`, in any order, which have to hold
+    // every shard of one split of this search; the result is that of
+    // find().
+    std::vector<Code> mergeShards(const std::vector<std::string>& paths){
+        std::vector<std::vector<Code>> shards;
+        std::vector<bool> seen;
+        for (auto& path: paths){
+            std::ifstream in(path);
+            if (!in)
+                throw std::runtime_error("Cannot open " + path);
+            std::string magic;
+            size_t version, index, count;
+            in >> magic >> version;
+            if (!in || magic != "cppcodes-shard" || version != 1)
+                throw std::runtime_error("Not a search shard: " + path);
+            readParameters(in, path);
+            in >> index >> count;
+            if (!in || index >= count)
+                throw std::runtime_error("Corrupted search shard: " + path);
+            if (shards.empty()){
+                shards.resize(count);
+                seen.assign(count, false);
+            }
+            if (count != shards.size())
+                throw std::invalid_argument("Shard " + path + " is of another split");
+            if (seen[index])
+                throw std::invalid_argument("Shard " + std::to_string(index) + " is given twice");
+            seen[index] = true;
+            readCodes(in, shards[index]);
+            if (!in)
+                throw std::runtime_error("Truncated search shard: " + path);
+        }
+        for (size_t i = 0; i < seen.size(); ++i)
+            if (!seen[i])
+                throw std::invalid_argument("Shard " + std::to_string(i) + " is missing");
+        std::vector<Code> codes;
+        for (auto& shard: shards)
+            for (auto& c: shard)
+                codes.push_back(std::move(c));
         return codes;
     }
 };
 }
 
-#endif
\ No newline at end of file
+#endif
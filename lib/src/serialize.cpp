@@ -0,0 +1,271 @@
+#include "serialize.h"
+#include <fstream>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <cstdint>
+#include <algorithm>
+
+using namespace cppcodes;
+
+static const char CODES_MAGIC[8] = {'C', 'O', 'D', 'S', 'L', 'I', 'S', 'T'};
+static const uint8_t STREAM_DISTANCES = 1;
+static const uint8_t CODE_SHIFTS = 1;
+static const uint8_t CODE_GENERATORS = 2;
+// Coefficient bytes read from a stream at a time.
+static const size_t DECODE_CHUNK = 1 << 16;
+
+static void header(std::vector<uint8_t>& out, bool distances){
+    out.insert(out.end(), CODES_MAGIC, CODES_MAGIC + sizeof(CODES_MAGIC));
+    out.push_back(CODES_FORMAT_VERSION);
+    out.push_back(distances ? STREAM_DISTANCES : 0);
+}
+
+static void putVarint(std::vector<uint8_t>& out, uint64_t x){
+    while (x >= 0x80){
+        out.push_back((uint8_t)(x | 0x80));
+        x >>= 7;
+    }
+    out.push_back((uint8_t)x);
+}
+
+static void encode(std::vector<uint8_t>& out, const Code& code, bool distances, xlong distance){
+    const std::vector<Series>& g = code.generators;
+    uint8_t flags = g.size() != code.n * code.k ? CODE_GENERATORS : 0;
+    size_t total = 0;
+    for (auto& s: g){
+        if (s.zero_shift != 0)
+            flags |= CODE_SHIFTS;
+        total += s.coeffs.size();
+    }
+    putVarint(out, code.n);
+    putVarint(out, code.k);
+    out.push_back(flags);
+    if (flags & CODE_GENERATORS)
+        putVarint(out, g.size());
+    for (auto& s: g)
+        putVarint(out, s.coeffs.size());
+    if (flags & CODE_SHIFTS)
+        for (auto& s: g)
+            putVarint(out, s.zero_shift);
+    size_t at = out.size(), bit = 0;
+    out.resize(at + (2 * total + 7) / 8, 0);
+    for (auto& s: g)
+        for (auto& c: s.coeffs){
+            out[at + bit / 8] |= (uint8_t)(c.value << (bit % 8));
+            bit += 2;
+        }
+    if (distances)
+        putVarint(out, ((uint64_t)distance << 1) ^ (uint64_t)(distance >> 63));
+}
+
+// Byte sources the decoder reads from: get() is -1 at the end, left()
+// bounds the bytes still to come.
+struct MemorySource{
+    const uint8_t* at;
+    const uint8_t* end;
+    int get(){ return at < end ? *at++ : -1; }
+    size_t left() const { return end - at; }
+    bool read(uint8_t* to, size_t size){
+        if ((size_t)(end - at) < size)
+            return false;
+        std::memcpy(to, at, size);
+        at += size;
+        return true;
+    }
+};
+
+struct StreamSource{
+    std::istream& in;
+    int get(){
+        int c = in.get();
+        return c == std::char_traits<char>::eof() ? -1 : c;
+    }
+    size_t left() const { return SIZE_MAX; }
+    bool read(uint8_t* to, size_t size){
+        return (bool)in.read((char*)to, size);
+    }
+};
+
+template <typename Source>
+static uint64_t getVarint(Source& in){
+    uint64_t x = 0;
+    for (size_t shift = 0; shift < 64; shift += 7){
+        int c = in.get();
+        if (c < 0)
+            throw std::runtime_error("Truncated code data");
+        x |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80))
+            return x;
+    }
+    throw std::runtime_error("Corrupted code data");
+}
+
+template <typename Source>
+static bool readHeader(Source& in){
+    uint8_t h[sizeof(CODES_MAGIC) + 2];
+    if (!in.read(h, sizeof(h)) || std::memcmp(h, CODES_MAGIC, sizeof(CODES_MAGIC)) != 0)
+        throw std::runtime_error("Not a code list");
+    if (h[sizeof(CODES_MAGIC)] != CODES_FORMAT_VERSION)
+        throw std::runtime_error("Unsupported code list version");
+    return h[sizeof(CODES_MAGIC) + 1] & STREAM_DISTANCES;
+}
+
+// false at the end of the stream; a record cut short throws.
+template <typename Source>
+static bool decode(Source& in, bool distances, Code& code, xlong& distance, std::vector<uint8_t>& buffer){
+    int first = in.get();
+    if (first < 0)
+        return false;
+    uint64_t n = first & 0x7f;
+    if (first & 0x80)
+        n |= getVarint(in) << 7;
+    uint64_t k = getVarint(in);
+    int flags = in.get();
+    if (flags < 0)
+        throw std::runtime_error("Truncated code data");
+    uint64_t count = (flags & CODE_GENERATORS) ? getVarint(in) : n * k;
+    // sizes that the rest of the record cannot hold are corrupted, not
+    // allocated: every generator takes a byte, every byte 4 coefficients
+    if (n > UINT32_MAX || k > UINT32_MAX || count > in.left() || (flags & ~(CODE_SHIFTS | CODE_GENERATORS)))
+        throw std::runtime_error("Corrupted code data");
+    // a stream does not know its size, so storage only grows with the
+    // bytes that arrived: one generator per size read, the coefficients
+    // once all their bytes are in
+    code = Code(n, k);
+    std::vector<uint64_t> sizes;
+    uint64_t total = 0;
+    for (uint64_t i = 0; i < count; ++i){
+        uint64_t size = getVarint(in);
+        total += size;
+        if (size > UINT32_MAX || total < size || (total + 3) / 4 > in.left())
+            throw std::runtime_error("Corrupted code data");
+        sizes.push_back(size);
+    }
+    code.generators.resize(count);
+    for (size_t i = 0; i < count; ++i){
+        uint64_t shift = (flags & CODE_SHIFTS) ? getVarint(in) : 0;
+        // the constant coefficient lies inside the series
+        if (shift > 0 && shift >= sizes[i])
+            throw std::runtime_error("Corrupted code data");
+        code.generators[i].zero_shift = shift;
+    }
+    uint64_t bytes = (2 * total + 7) / 8;
+    buffer.clear();
+    while (buffer.size() < bytes){
+        size_t at = buffer.size();
+        buffer.resize(at + std::min<uint64_t>(bytes - at, DECODE_CHUNK));
+        if (!in.read(buffer.data() + at, buffer.size() - at))
+            throw std::runtime_error("Truncated code data");
+    }
+    for (size_t i = 0; i < count; ++i)
+        code.generators[i].coeffs.resize(sizes[i]);
+    size_t bit = 0;
+    for (auto& s: code.generators)
+        for (auto& c: s.coeffs){
+            c.value = (buffer[bit / 8] >> (bit % 8)) & 3;
+            bit += 2;
+        }
+    distance = 0;
+    if (distances){
+        uint64_t z = getVarint(in);
+        distance = (xlong)(z >> 1) ^ -(xlong)(z & 1);
+    }
+    return true;
+}
+
+CodeWriter::CodeWriter(std::ostream& out_, bool distances_)
+: out(out_), distances(distances_), written(0), record() {
+    header(record, distances);
+    out.write((const char*)record.data(), record.size());
+}
+
+void CodeWriter::write(const Code& code, xlong distance){
+    record.clear();
+    encode(record, code, distances, distance);
+    if (!out.write((const char*)record.data(), record.size()))
+        throw std::runtime_error("Cannot write codes");
+    ++written;
+}
+
+CodeReader::CodeReader(std::istream& in_)
+: in(in_), distances(false), buffer() {
+    StreamSource s{in};
+    distances = readHeader(s);
+}
+
+bool CodeReader::next(Code& code, xlong& distance){
+    StreamSource s{in};
+    return decode(s, distances, code, distance, buffer);
+}
+
+PackedCodes::PackedCodes(bool distances_)
+: data(), distances(distances_), count(0) {
+    header(data, distances);
+}
+
+PackedCodes::PackedCodes(const uint8_t* bytes, size_t size)
+: data(bytes, bytes + size), distances(false), count(0) {
+    MemorySource s{data.data(), data.data() + data.size()};
+    distances = readHeader(s);
+    Code code(0);
+    xlong distance;
+    std::vector<uint8_t> buffer;
+    while (decode(s, distances, code, distance, buffer))
+        ++count;
+}
+
+void PackedCodes::add(const Code& code, xlong distance){
+    encode(data, code, distances, distance);
+    ++count;
+}
+
+std::vector<Code> PackedCodes::codes(std::vector<xlong>* out) const {
+    MemorySource s{data.data(), data.data() + data.size()};
+    readHeader(s);
+    std::vector<Code> result;
+    result.reserve(count);
+    if (out){
+        out->clear();
+        if (distances)
+            out->reserve(count);
+    }
+    Code code(0);
+    xlong distance;
+    std::vector<uint8_t> buffer;
+    while (decode(s, distances, code, distance, buffer)){
+        result.push_back(std::move(code));
+        if (out && distances)
+            out->push_back(distance);
+    }
+    return result;
+}
+
+void PackedCodes::save(const std::string& path) const {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write((const char*)data.data(), data.size());
+    out.close();
+    if (!out)
+        throw std::runtime_error("Cannot write " + path);
+}
+
+PackedCodes PackedCodes::load(const std::string& path){
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        throw std::runtime_error("Cannot open " + path);
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    return PackedCodes(bytes.data(), bytes.size());
+}
+
+PackedCodes cppcodes::serializeCodes(const std::vector<Code>& codes, const std::vector<xlong>* distances){
+    if (distances && distances->size() != codes.size())
+        throw std::invalid_argument("Expected one distance per code");
+    PackedCodes packed(distances != nullptr);
+    for (size_t i = 0; i < codes.size(); ++i)
+        packed.add(codes[i], distances ? (*distances)[i] : 0);
+    return packed;
+}
+
+std::vector<Code> cppcodes::deserializeCodes(const uint8_t* bytes, size_t size, std::vector<xlong>* distances){
+    return PackedCodes(bytes, size).codes(distances);
+}
@@ -0,0 +1,88 @@
+#ifndef SERIALIZE_H
+#define SERIALIZE_H
+
+#include "codes.h"
+#include <vector>
+#include <string>
+#include <iostream>
+#include <cstdint>
+
+namespace cppcodes{
+
+// Binary form of a list of codes. A stream starts with the 8 bytes
+// "CODSLIST", a format version and a flags byte (bit 0: a distance
+// follows every code), then holds one record per code up to its end:
+//
+//   n, k, code flags        varints; flag bit 0: some generator has a
+//                           zero_shift, bit 1: the code has other than
+//                           n * k generators
+//   [generator count]       varint, with code flag bit 1
+//   coefficient counts      varint per generator
+//   [zero shifts]           varint per generator, with code flag bit 0
+//   coefficients            2 bits each, generators in order, the first
+//                           coefficient in the low bits of the first
+//                           byte, padded to a whole byte
+//   [distance]              zigzag varint, with stream flag bit 0
+//
+// Varints are little endian base 128, so the format does not depend on
+// the byte order of the machine.
+const uint8_t CODES_FORMAT_VERSION = 1;
+
+// Writes codes to a stream one at a time.
+class CodeWriter{
+    public:
+        CodeWriter(std::ostream& out_, bool distances_ = false);
+        void write(const Code& code, xlong distance = 0);
+        size_t count() const { return written; };
+
+    private:
+        std::ostream& out;
+        bool distances;
+        size_t written;
+        std::vector<uint8_t> record;
+};
+
+// Reads codes written by CodeWriter or PackedCodes one at a time.
+class CodeReader{
+    public:
+        CodeReader(std::istream& in_);
+        bool hasDistances() const { return distances; };
+        // false at the end of the stream
+        bool next(Code& code, xlong& distance);
+
+    private:
+        std::istream& in;
+        bool distances;
+        std::vector<uint8_t> buffer;
+};
+
+// Codes in the binary form above, held in memory.
+class PackedCodes{
+    public:
+        std::vector<uint8_t> data;
+
+        PackedCodes(bool distances_ = false);
+        // Takes a whole stream, checking its header.
+        PackedCodes(const uint8_t* bytes, size_t size);
+
+        void add(const Code& code, xlong distance = 0);
+        bool hasDistances() const { return distances; };
+        size_t size() const { return count; };
+        // Every code, and their distances if `out` is given and they
+        // are stored.
+        std::vector<Code> codes(std::vector<xlong>* out = nullptr) const;
+
+        void save(const std::string& path) const;
+        static PackedCodes load(const std::string& path);
+
+    private:
+        bool distances;
+        size_t count;
+};
+
+PackedCodes serializeCodes(const std::vector<Code>& codes, const std::vector<xlong>* distances = nullptr);
+std::vector<Code> deserializeCodes(const uint8_t* bytes, size_t size, std::vector<xlong>* distances = nullptr);
+
+}
+
+#endif
@@ -2,6 +2,7 @@
 #define SERIES_H
 
 #include "gf4.h"
+#include "packed.h"
 #include <vector>
 #include <stdexcept>
 #include <iostream>
@@ -25,6 +26,10 @@ class Series{
             for (size_t i = 0; i < coeffs_.size(); ++i)
                 coeffs.push_back(gf4(coeffs_[i]));
         }
+        Series(const PackedSeries& p): coeffs(p.size), zero_shift(p.zero_shift) {
+            for (size_t i = 0; i < p.size; ++i)
+                coeffs[i] = p.at(i);
+        }
 
         Series& operator=(const Series& o){
             if (this != &o){
@@ -82,7 +87,18 @@ class Series{
             return *this;
         };
 
+        PackedSeries pack() const {
+            uint64_t lo = 0, hi = 0;
+            for (size_t i = 0; i < coeffs.size(); ++i){
+                lo |= (uint64_t)(coeffs[i].value & 1) << i;
+                hi |= (uint64_t)(coeffs[i].value >> 1) << i;
+            }
+            return PackedSeries(lo, hi, coeffs.size(), zero_shift);
+        };
+
         Series operator+(const Series& b) const {
+            if (std::max(zero_shift, b.zero_shift) + std::max(max_power(), b.max_power()) < (int)PACKED_CAPACITY)
+                return Series(pack() + b.pack());
             size_t c_shift = 0;
             std::vector<gf4> ks;
             int right = std::max(max_power(), b.max_power());
@@ -107,15 +123,78 @@ class Series{
         };
 
         Series operator*(const Series& b) const {
-            size_t c_shift = zero_shift + b.zero_shift;
-            int len = coeffs.size() + b.coeffs.size() - 1;
-            std::vector<gf4> ks(len);
-            for (size_t i = 0; i < coeffs.size(); ++i)
-                for (size_t j = 0; j < b.coeffs.size(); ++j)
-                    ks[i + j] = ks[i + j] + coeffs[i] * b.coeffs[j];
-            Series s(ks, c_shift);
-            s.strip();
-            return s;
+            if (coeffs.size() + b.coeffs.size() <= PACKED_CAPACITY + 1)
+                return Series(pack() * b.pack());
+            Series s;
+            return s.mulWide(*this, b);
+        };
+
+        // Overwrites this series with p, reusing the coefficient storage.
+        Series& assign(const PackedSeries& p){
+            coeffs.resize(p.size);
+            for (size_t i = 0; i < p.size; ++i)
+                coeffs[i] = p.at(i);
+            zero_shift = p.zero_shift;
+            return *this;
+        };
+
+        // this = this + b. Results that fit in a PackedSeries are written
+        // into the storage this series already has, so a reused series
+        // stops allocating once it has grown to the largest result.
+        Series& addInto(const Series& b){
+            if (std::max(zero_shift, b.zero_shift) + std::max(max_power(), b.max_power()) < (int)PACKED_CAPACITY)
+                return assign(pack() + b.pack());
+            return *this = *this + b;
+        };
+
+        Series& operator+=(const Series& b){
+            return addInto(b);
+        };
+
+        // this = a * b, reusing this series' storage like addInto(); a or
+        // b may be this series.
+        Series& mulInto(const Series& a, const Series& b){
+            if (a.coeffs.size() + b.coeffs.size() <= PACKED_CAPACITY + 1)
+                return assign(a.pack() * b.pack());
+            return mulWide(a, b);
+        };
+
+        // this = a * b for series too long for a PackedSeries: the same
+        // three carry-less products as PackedSeries::operator*, on
+        // bitplanes of as many words as the series need.
+        Series& mulWide(const Series& a, const Series& b){
+            size_t a_words = (a.coeffs.size() + 63) / 64, b_words = (b.coeffs.size() + 63) / 64;
+            // planes of a: lo, hi, lo ^ hi, then the same for b
+            std::vector<uint64_t> planes(3 * (a_words + b_words));
+            uint64_t* ap = planes.data();
+            uint64_t* bp = ap + 3 * a_words;
+            for (size_t i = 0; i < a.coeffs.size(); ++i){
+                ap[i / 64] |= (uint64_t)(a.coeffs[i].value & 1) << (i % 64);
+                ap[a_words + i / 64] |= (uint64_t)(a.coeffs[i].value >> 1) << (i % 64);
+            }
+            for (size_t i = 0; i < b.coeffs.size(); ++i){
+                bp[i / 64] |= (uint64_t)(b.coeffs[i].value & 1) << (i % 64);
+                bp[b_words + i / 64] |= (uint64_t)(b.coeffs[i].value >> 1) << (i % 64);
+            }
+            for (size_t w = 0; w < a_words; ++w)
+                ap[2 * a_words + w] = ap[w] ^ ap[a_words + w];
+            for (size_t w = 0; w < b_words; ++w)
+                bp[2 * b_words + w] = bp[w] ^ bp[b_words + w];
+
+            size_t words = a_words + b_words;
+            std::vector<uint64_t> p(3 * words);
+            clmulWords(ap, a_words, bp, b_words, &p[0]);
+            clmulWords(ap + a_words, a_words, bp + b_words, b_words, &p[words]);
+            clmulWords(ap + 2 * a_words, a_words, bp + 2 * b_words, b_words, &p[2 * words]);
+
+            zero_shift = a.zero_shift + b.zero_shift;
+            coeffs.resize(a.coeffs.size() + b.coeffs.size() - 1);
+            for (size_t i = 0; i < coeffs.size(); ++i){
+                uint64_t lo = (p[i / 64] ^ p[words + i / 64]) >> (i % 64);
+                uint64_t hi = (p[2 * words + i / 64] ^ p[i / 64]) >> (i % 64);
+                coeffs[i].value = (short)((lo & 1) | ((hi & 1) << 1));
+            }
+            return strip();
         };
 
         bool operator<(const Series& o){
@@ -184,12 +263,21 @@ class Series{
         }
 };
 
+// Coefficients are packed 32 to a word and each word is mixed into the
+// hash, so long series hash by all of their coefficients.
 struct SeriesHasher{
     std::size_t operator()(const Series& s) const {
-        int v = 0;
-        for (auto it = s.coeffs.begin(); it != s.coeffs.end(); ++it)
-            v = v * GF4_SIZE + it->value;
-        return std::hash<int>{}((int)s.zero_shift) ^ std::hash<int>{}(v);
+        uint64_t h = s.zero_shift * 0x9E3779B97F4A7C15ULL ^ s.coeffs.size();
+        uint64_t word = 0;
+        for (size_t i = 0; i < s.coeffs.size(); ++i){
+            word = word << 2 | s.coeffs[i].value;
+            if (i % 32 == 31 || i + 1 == s.coeffs.size()){
+                h = (h ^ word) * 0xC2B2AE3D27D4EB4FULL;
+                h ^= h >> 29;
+                word = 0;
+            }
+        }
+        return h;
     }
 };
 }
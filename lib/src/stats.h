@@ -0,0 +1,190 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <thread>
+#include <functional>
+
+// Building with -DCPPCODES_STATS=0 compiles every counter out.
+#ifndef CPPCODES_STATS
+#define CPPCODES_STATS 1
+#endif
+
+namespace cppcodes{
+
+// Search counters come first, they are what a search keeps for itself;
+// the rest are recorded by Code for every call. Names ending in _ns are
+// times in nanoseconds.
+enum StatsCounter{
+    INITIALIZE_NS,
+    SEARCH_NS,
+    GENERATE_NODES,
+    GENERATE_LOOKUPS,
+    GENERATE_HITS,
+    APPEND_NODES,
+    BOUND_PRUNED,
+    ROW_NODES,
+    ROW_REJECTED,
+    LEAVES,
+    ORDER_CHECK_REJECTED,
+    ORDER_CHECK_NS,
+    CANONICAL_REJECTED,
+    DISTANCE_REJECTED,
+    CODES_FOUND,
+    SEARCH_COUNTERS,
+    MIN_DISTANCE_CALLS = SEARCH_COUNTERS,
+    MIN_DISTANCE_NS,
+    TRELLIS_POPS,
+    TRELLIS_RELAXATIONS,
+    MIN_DISTANCE_OLD_POPS,
+    MIN_DISTANCE_OLD_ENTRIES,
+    FIND_ORTHOGONAL_CALLS,
+    FIND_ORTHOGONAL_NS,
+    STATS_COUNTERS
+};
+
+const char* const STATS_NAMES[STATS_COUNTERS] = {
+    "initialize_ns",
+    "search_ns",
+    "generate_nodes",
+    "generate_lookups",
+    "generate_hits",
+    "append_nodes",
+    "bound_pruned",
+    "row_nodes",
+    "row_rejected",
+    "leaves",
+    "order_check_rejected",
+    "order_check_ns",
+    "canonical_rejected",
+    "distance_rejected",
+    "codes_found",
+    "min_distance_calls",
+    "min_distance_ns",
+    "trellis_pops",
+    "trellis_relaxations",
+    "min_distance_old_pops",
+    "min_distance_old_entries",
+    "find_orthogonal_calls",
+    "find_orthogonal_ns",
+};
+
+inline std::atomic<bool>& statsFlag(){
+    static std::atomic<bool> flag(false);
+    return flag;
+}
+
+// Counting is off until enabled at run time.
+inline bool statsEnabled(){
+    return CPPCODES_STATS && statsFlag().load(std::memory_order_relaxed);
+}
+
+inline void enableStats(bool on){
+    statsFlag().store(on);
+}
+
+inline uint64_t statsClock(){
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Plain counters owned by one thread, e.g. by one search walk.
+struct StatsCounts{
+    uint64_t values[STATS_COUNTERS];
+    StatsCounts(){ clear(); };
+
+    void clear(){
+        for (auto& v: values)
+            v = 0;
+    }
+
+    uint64_t& operator[](size_t i){ return values[i]; }
+
+    void add(const StatsCounts& o, size_t end = STATS_COUNTERS){
+        for (size_t i = 0; i < end; ++i)
+            values[i] += o.values[i];
+    }
+
+    std::map<std::string, uint64_t> toMap() const {
+        std::map<std::string, uint64_t> m;
+        for (size_t i = 0; i < STATS_COUNTERS; ++i)
+            m[STATS_NAMES[i]] = values[i];
+        return m;
+    }
+};
+
+// Process-wide counters, one cache-line aligned shard per thread slot so
+// that threads counting at once do not share lines.
+class GlobalStats{
+    public:
+        static const size_t SHARDS = 64;
+
+        static GlobalStats& instance(){
+            static GlobalStats stats;
+            return stats;
+        }
+
+        void add(size_t counter, uint64_t v){
+            shards[shard()].values[counter].fetch_add(v, std::memory_order_relaxed);
+        }
+
+        void add(const StatsCounts& c, size_t end = STATS_COUNTERS){
+            Shard& s = shards[shard()];
+            for (size_t i = 0; i < end; ++i)
+                if (c.values[i])
+                    s.values[i].fetch_add(c.values[i], std::memory_order_relaxed);
+        }
+
+        StatsCounts snapshot() const {
+            StatsCounts c;
+            for (auto& s: shards)
+                for (size_t i = 0; i < STATS_COUNTERS; ++i)
+                    c.values[i] += s.values[i].load(std::memory_order_relaxed);
+            return c;
+        }
+
+        void reset(){
+            for (auto& s: shards)
+                for (auto& v: s.values)
+                    v.store(0, std::memory_order_relaxed);
+        }
+
+    private:
+        struct alignas(64) Shard{
+            std::atomic<uint64_t> values[STATS_COUNTERS];
+        };
+        Shard shards[SHARDS];
+
+        GlobalStats(){ reset(); };
+
+        static size_t shard(){
+            static thread_local size_t s = std::hash<std::thread::id>()(std::this_thread::get_id()) % SHARDS;
+            return s;
+        }
+};
+
+// Adds the time of a scope to a global counter when counting is on.
+class StatsTimer{
+    public:
+        StatsTimer(size_t counter_, size_t calls_ = STATS_COUNTERS)
+        : counter(counter_), calls(calls_), start(statsEnabled() ? statsClock() : 0) {};
+        ~StatsTimer(){
+            if (start == 0)
+                return;
+            GlobalStats::instance().add(counter, statsClock() - start);
+            if (calls < STATS_COUNTERS)
+                GlobalStats::instance().add(calls, 1);
+        }
+    private:
+        size_t counter;
+        size_t calls;
+        uint64_t start;
+};
+
+}
+
+#endif
@@ -0,0 +1,212 @@
+#include "trellis.h"
+#include "stats.h"
+#include "branch.h"
+
+using namespace cppcodes;
+
+// n output symbols of two bits each are packed into one word
+static const size_t MAX_PACKED_OUTPUTS = 32;
+
+bool Trellis::fits(Code& code){
+    if (code.n > MAX_PACKED_OUTPUTS)
+        return false;
+    size_t memory = 0;
+    for (size_t i = 0; i < code.k; ++i)
+        memory += code.maxSize(i) - 1;
+    size_t bits = 2 * (memory + code.k);
+    return bits < 32 && ((size_t)1 << bits) <= TRELLIS_MAX_EDGES;
+}
+
+Trellis::Trellis(Code& code)
+: n(code.n)
+, k(code.k)
+, memory(0)
+, states(0)
+, inputs((size_t)1 << (2 * code.k))
+, lags()
+, state_out()
+, input_out((size_t)1 << (2 * code.k))
+, input_next((size_t)1 << (2 * code.k))
+, shift_mask(0)
+{
+    std::vector<size_t> offsets;
+    for (size_t i = 0; i < k; ++i){
+        offsets.push_back(memory);
+        lags.push_back(code.maxSize(i) - 1);
+        memory += lags.back();
+    }
+    states = (size_t)1 << (2 * memory);
+
+    // output of each state symbol and each input symbol on its own,
+    // the branch output is their sum since the code is linear
+    std::vector<uint64_t> digit_out(memory * GF4_SIZE);
+    for (size_t i = 0; i < k; ++i){
+        for (size_t j = 0; j <= lags[i]; ++j){
+            for (short v = 1; v < (short)GF4_SIZE; ++v){
+                uint64_t out = 0;
+                for (size_t c = 0; c < n; ++c){
+                    uint64_t sym = PROD[v][code.generators[i * n + c].at(lags[i] - j).value];
+                    out |= sym << (2 * c);
+                }
+                if (j < lags[i])
+                    digit_out[(offsets[i] + j) * GF4_SIZE + v] = out;
+                else
+                    for (size_t u = 0; u < inputs; ++u)
+                        if (((u >> (2 * i)) & 3) == (size_t)v)
+                            input_out[u] ^= out;
+            }
+        }
+    }
+
+    state_out.resize(states);
+    for (size_t s = 1; s < states; ++s){
+        size_t p = __builtin_ctzll(s) / 2;
+        size_t v = (s >> (2 * p)) & 3;
+        state_out[s] = state_out[s ^ (v << (2 * p))] ^ digit_out[p * GF4_SIZE + v];
+    }
+
+    // every row drops its oldest symbol and takes its input as the newest
+    for (size_t i = 0; i < k; ++i){
+        if (lags[i] == 0)
+            continue;
+        shift_mask |= (uint32_t)((((size_t)1 << (2 * lags[i] - 2)) - 1) << (2 * offsets[i]));
+        for (size_t u = 0; u < inputs; ++u)
+            input_next[u] |= (uint32_t)(((u >> (2 * i)) & 3) << (2 * (offsets[i] + lags[i] - 1)));
+    }
+}
+
+// Dijkstra from state 0 back to state 0 with a bucket queue: edge
+// weights are at most n, so n + 1 buckets indexed by distance modulo
+// n + 1 hold every tentative distance. Paths of weight bound or more are
+// never queued, so the search ends as soon as every shorter one is out.
+xlong Trellis::minDistance(xlong bound) const {
+    const uint32_t infinity = UINT32_MAX;
+    const BranchWeights expand = branchWeights();
+    std::vector<uint32_t> d(states, infinity);
+    std::vector<uint8_t> w(inputs);
+    std::vector<std::vector<uint32_t>> buckets(n + 1);
+    size_t pending = 0;
+    uint64_t pops = 0, relaxations = 0;
+    auto record = [&](){
+        if (statsEnabled()){
+            GlobalStats::instance().add(TRELLIS_POPS, pops);
+            GlobalStats::instance().add(TRELLIS_RELAXATIONS, relaxations);
+        }
+    };
+
+    bool cut = false;
+    expand(state_out[0], input_out.data(), inputs, w.data());
+    for (size_t u = 1; u < inputs; ++u){
+        uint32_t v = input_next[u], t = w[u];
+        if (t >= bound){
+            cut = true;
+            continue;
+        }
+        if (t < d[v]){
+            d[v] = t;
+            buckets[t].push_back(v);
+            ++pending;
+        }
+    }
+
+    for (uint32_t curd = 0; pending > 0; ++curd){
+        auto& bucket = buckets[curd % (n + 1)];
+        while (!bucket.empty()){
+            uint32_t v = bucket.back();
+            bucket.pop_back();
+            --pending;
+            if (d[v] != curd)
+                continue;
+            ++pops;
+            if (v == 0){
+                record();
+                return curd;
+            }
+            uint32_t shifted = (v >> 2) & shift_mask;
+            expand(state_out[v], input_out.data(), inputs, w.data());
+            for (size_t u = 0; u < inputs; ++u){
+                uint32_t nv = shifted | input_next[u], t = curd + w[u];
+                if (t >= bound){
+                    cut = true;
+                    continue;
+                }
+                if (t < d[nv]){
+                    d[nv] = t;
+                    buckets[t % (n + 1)].push_back(nv);
+                    ++pending;
+                    ++relaxations;
+                }
+            }
+        }
+    }
+    record();
+    return cut ? bound : -1;
+}
+
+// Number of paths leaving state 0 and first coming back to it, for every
+// weight up to max_weight. Zero-weight edges stay within a weight, so
+// states are visited in topological order of the zero-weight edges; a
+// cycle of such edges would give infinitely many paths of one weight.
+std::vector<xlong> Trellis::distanceSpectrum(size_t max_weight) const {
+    // every state is visited once per weight, so the branches are
+    // tabulated up front
+    const BranchWeights expand = branchWeights();
+    std::vector<uint32_t> next(states * inputs);
+    std::vector<uint8_t> weight(states * inputs);
+    for (size_t v = 0; v < states; ++v){
+        expand(state_out[v], input_out.data(), inputs, &weight[v * inputs]);
+        for (size_t u = 0; u < inputs; ++u)
+            next[v * inputs + u] = (((uint32_t)v >> 2) & shift_mask) | input_next[u];
+    }
+    std::vector<uint32_t> order, indegree(states);
+    for (size_t v = 1; v < states; ++v)
+        for (size_t u = 0; u < inputs; ++u)
+            if (weight[v * inputs + u] == 0 && next[v * inputs + u] != 0)
+                ++indegree[next[v * inputs + u]];
+    for (size_t v = 0; v < states; ++v)
+        if (indegree[v] == 0)
+            order.push_back(v);
+    for (size_t i = 0; i < order.size(); ++i){
+        uint32_t v = order[i];
+        if (v == 0)
+            continue;
+        for (size_t u = 0; u < inputs; ++u)
+            if (weight[v * inputs + u] == 0 && next[v * inputs + u] != 0)
+                if (--indegree[next[v * inputs + u]] == 0)
+                    order.push_back(next[v * inputs + u]);
+    }
+    if (order.size() != states)
+        throw std::logic_error("Catastrophic code");
+    // edges into state 0 end a path and are left out of the degrees, so
+    // 0 is taken last in every layer, after whatever reaches it at no
+    // extra weight
+    order.erase(order.begin());
+    order.push_back(0);
+
+    // paths[w % (n + 1)][v] counts paths of weight w from state 0 to v
+    std::vector<std::vector<xlong>> paths(n + 1, std::vector<xlong>(states));
+    std::vector<xlong> spectrum(max_weight + 1);
+    for (size_t u = 1; u < inputs; ++u)
+        if (weight[u] <= max_weight)
+            paths[weight[u]][next[u]] += 1;
+
+    for (size_t curd = 0; curd <= max_weight; ++curd){
+        auto& layer = paths[curd % (n + 1)];
+        for (auto v: order){
+            xlong count = layer[v];
+            if (count == 0)
+                continue;
+            layer[v] = 0;
+            if (v == 0){
+                spectrum[curd] += count;
+                continue;
+            }
+            const uint32_t* nv = &next[v * inputs];
+            const uint8_t* w = &weight[v * inputs];
+            for (size_t u = 0; u < inputs; ++u)
+                if (curd + w[u] <= max_weight)
+                    paths[(curd + w[u]) % (n + 1)][nv[u]] += count;
+        }
+    }
+    return spectrum;
+}
@@ -0,0 +1,43 @@
+#ifndef TRELLIS_H
+#define TRELLIS_H
+
+#include "codes.h"
+#include <vector>
+#include <cstdint>
+
+// Largest states * inputs product for which the dense tables are built.
+const size_t TRELLIS_MAX_EDGES = 1 << 24;
+
+namespace cppcodes{
+
+// Trellis of a convolutional code. A state keeps lags[i] symbols of row
+// i, two bits per symbol, row 0 in the lowest bits and the oldest symbol
+// of every row first, the same numbering as Code::minDistanceOld. Only
+// the outputs of every state and every input are tabulated; the branches
+// leaving a state are expanded together when the state is reached, see
+// branch.h.
+class Trellis{
+    public:
+        size_t n;
+        size_t k;
+        size_t memory;
+        size_t states;
+        size_t inputs;
+        std::vector<size_t> lags;
+        // a branch outputs state_out[state] ^ input_out[input] and leads
+        // to (state >> 2 & shift_mask) | input_next[input]
+        std::vector<uint64_t> state_out;
+        std::vector<uint64_t> input_out;
+        std::vector<uint32_t> input_next;
+        uint32_t shift_mask;
+
+        Trellis(Code& code);
+        static bool fits(Code& code);
+        // Distance of the code if it is below bound, bound otherwise.
+        xlong minDistance(xlong bound = INFTY) const;
+        std::vector<xlong> distanceSpectrum(size_t max_weight) const;
+};
+
+}
+
+#endif
@@ -0,0 +1,764 @@
+// Regression checks of the native library. Prints every failed check and
+// exits with status 1 if there was one.
+//
+//     ./tests [--filter substring]
+
+#include "gf4.h"
+#include "series.h"
+#include "codes.h"
+#include "search.h"
+#include "serialize.h"
+#include "rgg.h"
+#include "batch.h"
+#include "trellis.h"
+#include "incremental.h"
+#include "fixed.h"
+#include "branch.h"
+#include <vector>
+#include <string>
+#include <functional>
+#include <sstream>
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <future>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <tuple>
+#include <set>
+
+using namespace cppcodes;
+
+static size_t failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)){ \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond << std::endl; \
+            ++failures; \
+        } \
+    } while (0)
+
+// Code from the toString() form, rows split by "||" and generators by "|".
+static Code parseCode(const std::string& s, size_t n, size_t k){
+    std::vector<Series> generators;
+    std::string g;
+    std::istringstream tokens(s);
+    while (std::getline(tokens, g, '|'))
+        if (!g.empty())
+            generators.push_back(Series(g));
+    return Code(generators, n, k);
+}
+
+static std::string join(const std::vector<xlong>& v){
+    std::string s;
+    for (auto x: v)
+        s += (s.empty() ? "" : " ") + std::to_string(x);
+    return s;
+}
+
+// Product of two series one coefficient pair at a time.
+static Series naiveProduct(const Series& a, const Series& b){
+    std::vector<gf4> ks(a.coeffs.size() + b.coeffs.size() - 1);
+    for (size_t i = 0; i < a.coeffs.size(); ++i)
+        for (size_t j = 0; j < b.coeffs.size(); ++j)
+            ks[i + j] = ks[i + j] + a.coeffs[i] * b.coeffs[j];
+    Series s(ks, a.zero_shift + b.zero_shift);
+    s.strip();
+    return s;
+}
+
+static Series randomSeries(std::mt19937& random, size_t size, size_t shift = 0){
+    std::vector<gf4> coeffs(size);
+    for (auto& c: coeffs)
+        c = gf4((char)(random() % 4));
+    coeffs[size - 1] = gf4((char)(1 + random() % 3));
+    return Series(coeffs, std::min(shift, size - 1));
+}
+
+static void seriesTests(){
+    // products past PACKED_CAPACITY take the multi-word path
+    std::mt19937 random(1);
+    for (size_t a: {1, 20, 63, 64, 65, 100, 128, 200})
+        for (size_t b: {1, 2, 64, 70, 129})
+            for (size_t shift: {0, 3}){
+                Series x = randomSeries(random, a, shift), y = randomSeries(random, b);
+                Series z = naiveProduct(x, y);
+                CHECK(x * y == z);
+                Series into;
+                CHECK(into.mulInto(x, y) == z);
+                CHECK(x.mulInto(x, y) == z);
+            }
+}
+
+// Paths leaving the zero state and first coming back to it, counted by
+// running the encoder on every input sequence: an output symbol is the
+// sum over rows i of g[i][c][j] times the input of row i j steps ago.
+static std::vector<xlong> bruteSpectrum(Code& c, size_t max_weight){
+    std::vector<size_t> lags;
+    for (size_t i = 0; i < c.k; ++i)
+        lags.push_back(c.maxSize(i) - 1);
+    std::vector<xlong> spectrum(max_weight + 1);
+    // history[i] holds the inputs of row i, newest last
+    std::vector<std::vector<gf4>> history(c.k);
+    std::function<void(size_t, bool)> walk = [&](size_t weight, bool first){
+        for (size_t u = first ? 1 : 0; u < ((size_t)1 << (2 * c.k)); ++u){
+            for (size_t i = 0; i < c.k; ++i)
+                history[i].push_back(gf4((char)((u >> (2 * i)) & 3)));
+            size_t w = weight;
+            for (size_t col = 0; col < c.n; ++col){
+                gf4 out;
+                for (size_t i = 0; i < c.k; ++i)
+                    for (size_t j = 0; j <= lags[i] && j < history[i].size(); ++j)
+                        out = out + c.generators[i * c.n + col].at(j) * history[i][history[i].size() - 1 - j];
+                w += out.value != 0;
+            }
+            bool zero = true;
+            for (size_t i = 0; i < c.k; ++i)
+                for (size_t j = 0; j < lags[i] && j < history[i].size(); ++j)
+                    zero = zero && history[i][history[i].size() - 1 - j].value == 0;
+            if (w <= max_weight){
+                if (zero)
+                    ++spectrum[w];
+                else
+                    walk(w, false);
+            }
+            for (size_t i = 0; i < c.k; ++i)
+                history[i].pop_back();
+        }
+    };
+    walk(0, true);
+    return spectrum;
+}
+
+static void spectrumTests(){
+    Code c = parseCode("11|1u|1v", 3, 1);
+    CHECK(join(c.distanceSpectrum(8)) == "0 0 0 0 0 0 3 0 9");
+
+    // state 0 is reached over a zero-weight edge within a weight
+    Code d = parseCode("11|01|1||01|11|0", 3, 2);
+    CHECK(d.minDistance() == 2);
+    CHECK(join(d.distanceSpectrum(7)) == "0 0 3 12 54 195 882 3435");
+    CHECK(join(d.distanceSpectrum(7)) == join(bruteSpectrum(d, 7)));
+
+    Code e = parseCode("1u|10|v1|11||01|1v|u|v1", 4, 2);
+    CHECK(join(e.distanceSpectrum(6)) == join(bruteSpectrum(e, 6)));
+}
+
+static void orthogonalTests(){
+    Code c = parseCode("11|1u|1v", 3, 1);
+    Code o = c.findOrthogonal();
+    CHECK(o.toString() == "10|11|11||v|u|1");
+    CHECK(c.isOrthogonal(o));
+    CHECK(o.rank() == 2);
+
+    Code d = parseCode("1u1|11v|v01|1uu", 4, 1);
+    Code p = d.findOrthogonal();
+    CHECK(d.isOrthogonal(p));
+    CHECK(p.rank() == 3);
+    CHECK(p.toString() == d.findOrthogonal().toString());
+
+    // the packed test against sums of Series products, for random pairs
+    // and pairs that are orthogonal
+    std::mt19937 random(2);
+    for (size_t t = 0; t < 200; ++t){
+        size_t n = 2 + t % 3, k = 1 + t % 2;
+        std::vector<Series> g, h;
+        for (size_t i = 0; i < n * k; ++i){
+            g.push_back(randomSeries(random, 1 + random() % 8));
+            h.push_back(randomSeries(random, 1 + random() % 8));
+        }
+        Code x(g, n, k), y(h, n, k);
+        bool expected = true;
+        for (size_t i = 0; i < k; ++i)
+            for (size_t j = 0; j < k; ++j){
+                Series s;
+                for (size_t m = 0; m < n; ++m)
+                    s = s + naiveProduct(g[i * n + m].inverse().conj(), h[j * n + m]);
+                s.strip();
+                expected = expected && s.coeffs.size() == 1 && s.coeffs[0] == 0;
+            }
+        CHECK(x.isOrthogonal(y) == expected);
+        if (k == 1 && t % 4 == 0){
+            try{
+                Code z = x.findOrthogonal();
+                CHECK(x.isOrthogonal(z));
+            } catch (const std::logic_error&){
+            }
+        }
+    }
+
+    // no rows of degree 3 are independent and orthogonal to this one
+    Code e = parseCode("1u11|110u|1u0v|1u11", 4, 1);
+    bool threw = false;
+    try{
+        e.findOrthogonal();
+    } catch (const std::logic_error&){
+        threw = true;
+    }
+    CHECK(threw);
+    uint8_t data[2 * 4 * 4] = {1, 2, 1, 1, 1, 1, 0, 2, 1, 2, 0, 3, 1, 2, 1, 1,
+                               1, 2, 0, 0, 1, 1, 3, 0, 1, 3, 0, 1, 1, 1, 2, 2};
+    xlong out[2];
+    minDistanceBatch(data, 2, 4, 4, 1, true, 1, out);
+    Code f = parseCode("1u00|11v0|1v01|11uu", 4, 1);
+    CHECK(out[0] == 0 && out[1] == f.findOrthogonal().minDistance());
+}
+
+// minDistanceBatch over coefficient arrays gives Code::minDistance()
+// and the distance of findOrthogonal() code by code, over several chunks
+// and any thread count.
+static void batchTests(){
+    for (auto params: {std::make_tuple(4, 3, 1, 150), std::make_tuple(4, 2, 2, 100)}){
+        SearchSelfOrthogonal s(std::get<0>(params), std::get<1>(params), std::get<2>(params));
+        std::vector<Code> codes = s.find();
+        codes.erase(codes.begin() + std::min<size_t>(codes.size(), std::get<3>(params)), codes.end());
+        size_t generators = codes[0].generators.size(), length = std::get<1>(params) + 1;
+        std::vector<uint8_t> data(codes.size() * generators * length);
+        std::vector<xlong> distances, orthogonal;
+        for (size_t c = 0; c < codes.size(); ++c){
+            for (size_t g = 0; g < generators; ++g){
+                const Series& x = codes[c].generators[g];
+                for (size_t i = 0; i < x.coeffs.size(); ++i)
+                    data[(c * generators + g) * length + x.zero_shift + i] = x.coeffs[i].value;
+            }
+            distances.push_back(codes[c].minDistance());
+            try{
+                orthogonal.push_back(codes[c].findOrthogonal().minDistance());
+            } catch (const std::logic_error&){
+                orthogonal.push_back(0);
+            }
+        }
+        for (size_t threads: {1, 0}){
+            std::vector<xlong> out(codes.size());
+            minDistanceBatch(data.data(), codes.size(), generators, length, codes[0].k, false, threads, out.data());
+            CHECK(out == distances);
+            minDistanceBatch(data.data(), codes.size(), generators, length, codes[0].k, true, threads, out.data());
+            CHECK(out == orthogonal);
+        }
+    }
+}
+
+// Every branch weight kernel this CPU runs gives the symbol count of
+// every branch, for counts of 4^k inputs and for outputs of up to 32
+// symbols.
+static void branchTests(){
+    BranchWeights portable = branchWeights("portable");
+    CHECK(portable != nullptr && branchWeights() != nullptr);
+    std::vector<BranchWeights> kernels = {branchWeights()};
+    for (const char* name: {"portable", "avx2", "avx512"})
+        if (branchWeights(name))
+            kernels.push_back(branchWeights(name));
+    CHECK(branchWeights("none") == nullptr);
+
+    std::mt19937_64 random(22);
+    bool ok = true;
+    for (size_t count: {4, 16, 64, 256, 1024})
+        for (size_t t = 0; t < 20; ++t){
+            size_t symbols = 1 + random() % 32;
+            uint64_t mask = symbols == 32 ? ~0ULL : ((uint64_t)1 << (2 * symbols)) - 1;
+            std::vector<uint64_t> inputs(count);
+            for (auto& x: inputs)
+                x = random() & mask;
+            uint64_t out = random() & mask;
+            for (auto kernel: kernels){
+                std::vector<uint8_t> weights(count, 0xFF);
+                kernel(out, inputs.data(), count, weights.data());
+                for (size_t u = 0; u < count; ++u)
+                    ok = ok && weights[u] == symbolWeight(out ^ inputs[u]);
+            }
+        }
+    CHECK(ok);
+}
+
+// Bounded distance queries answer as the full search would: Code,
+// Trellis and, for k = 1, both FixedCode entry points return min(d,
+// bound), and the comparisons follow d, which the old search confirms.
+static void boundTests(){
+    for (auto params: {std::make_tuple(3, 4, 1), std::make_tuple(4, 3, 1), std::make_tuple(5, 2, 1), std::make_tuple(4, 2, 2)}){
+        size_t n = std::get<0>(params), degree = std::get<1>(params);
+        SearchSelfOrthogonal s(n, degree, std::get<2>(params));
+        std::vector<Code> codes = s.find();
+        codes.erase(codes.begin() + std::min<size_t>(codes.size(), 200), codes.end());
+        PackedDistance fixed = fixedDistanceFor(n, degree);
+        bool ok = true;
+        for (auto& c: codes){
+            Trellis trellis(c);
+            xlong d = trellis.minDistance();
+            ok = ok && d == c.minDistanceOld() && d == c.minDistance();
+            ok = ok && c.hasDistanceAtLeast(d) && !c.hasDistanceAtLeast(d + 1);
+            ok = ok && c.compareDistance(d) == DISTANCE_EQUAL && c.compareDistance(d - 1) == DISTANCE_ABOVE
+                && c.compareDistance(d + 1) == DISTANCE_BELOW;
+            std::vector<PackedSeries> columns;
+            for (auto& g: c.generators){
+                PackedSeries p = g.pack();
+                columns.push_back(PackedSeries(p.lo, p.hi, degree + 1, 0));
+            }
+            for (xlong bound: {(xlong)1, d - 1, d, d + 1}){
+                xlong expected = std::min(d, bound), x = -1;
+                ok = ok && c.minDistance(bound) == expected && trellis.minDistance(bound) == expected;
+                if (c.k == 1)
+                    ok = ok && fixedMinDistance(c, x, bound) && x == expected && fixed(columns.data(), bound) == expected;
+            }
+        }
+        CHECK(ok);
+    }
+}
+
+// IncrementalDistance fed the columns of search results in order, so
+// that mostly the last column changes as in append(), gives the distance
+// of a Trellis of each code, cut at any bound.
+static void incrementalTests(){
+    for (auto params: {std::make_pair(3, 4), std::make_pair(4, 3), std::make_pair(5, 2)}){
+        size_t n = params.first, degree = params.second;
+        SearchSelfOrthogonal s(n, degree);
+        IncrementalDistance incremental(n, degree);
+        std::vector<PackedSeries> columns(n);
+        bool ok = true;
+        for (auto& c: s.find()){
+            bool changed = false;
+            for (size_t i = 0; i < n; ++i){
+                PackedSeries p = c.generators[i].pack();
+                PackedSeries g(p.lo, p.hi, degree + 1, 0);
+                changed = changed || !(g == columns[i]);
+                if (changed){
+                    incremental.setColumn(i, g);
+                    columns[i] = g;
+                }
+            }
+            xlong d = Trellis(c).minDistance();
+            ok = ok && incremental.minDistance() == d;
+            for (xlong bound: {d - 1, d, d + 1})
+                ok = ok && incremental.minDistance(bound) == std::min(d, bound);
+        }
+        CHECK(ok);
+    }
+}
+
+static std::string codeList(const std::vector<Code>& codes){
+    std::string s;
+    for (auto c: codes)
+        s += c.toString() + "\n";
+    return s;
+}
+
+// Threaded searches split generate() into tasks and put the codes of the
+// tasks back in order, so any thread count gives the serial list.
+static void threadsTests(){
+    for (auto params: {std::make_pair(3, 4), std::make_pair(4, 3)}){
+        SearchSelfOrthogonal s(params.first, params.second);
+        std::string expected = codeList(s.find());
+        CHECK(!expected.empty());
+        for (size_t threads: {2, 3, 8})
+            CHECK(codeList(s.find(threads)) == expected);
+    }
+}
+
+static void checkpointTests(){
+    SearchSelfOrthogonal s(3, 3);
+    std::string expected = codeList(s.find());
+    CHECK(!expected.empty());
+
+    // every resume has to get past its own cursor
+    SearchCursor cursor;
+    std::vector<Code> codes;
+    for (size_t calls = 0; !cursor.done && calls < 1000000; ++calls)
+        s.next(cursor, codes, SIZE_MAX, 1);
+    CHECK(cursor.done);
+    CHECK(codeList(codes) == expected);
+
+    const char* path = "checkpoint.tmp";
+    std::remove(path);
+    CHECK(codeList(s.find(path, 0, 1)) == expected);
+    CHECK(codeList(s.find(path, 0, 1)) == expected);
+    std::remove(path);
+}
+
+// A distance-targeted search prunes without losing codes: it returns the
+// codes of the plain search whose distance reaches the target, in order,
+// serial or threaded, for k = 1 and k = 2.
+static void distanceTests(){
+    for (auto params: {std::make_tuple(3, 4, 1), std::make_tuple(4, 3, 1), std::make_tuple(4, 2, 2)}){
+        SearchSelfOrthogonal s(std::get<0>(params), std::get<1>(params), std::get<2>(params));
+        std::vector<Code> all = s.find();
+        std::vector<xlong> distances;
+        for (auto& c: all)
+            distances.push_back(c.minDistance());
+        xlong best = *std::max_element(distances.begin(), distances.end());
+        for (xlong d = best - 2; d <= best + 1; ++d){
+            std::vector<Code> expected;
+            for (size_t i = 0; i < all.size(); ++i)
+                if (distances[i] >= d)
+                    expected.push_back(all[i]);
+            s.setMinDistance(d);
+            CHECK(codeList(s.find()) == codeList(expected));
+            CHECK(codeList(s.find(3)) == codeList(expected));
+        }
+        s.setMinDistance(0);
+    }
+}
+
+// Canonical mode returns one code of every equivalence class the plain
+// search meets, and no class twice.
+static void canonicalTests(){
+    for (auto params: {std::make_pair(3, 4), std::make_pair(4, 3)}){
+        SearchSelfOrthogonal s(params.first, params.second);
+        std::set<std::string> classes;
+        for (auto& c: s.find())
+            classes.insert(c.canonical().toString());
+        s.setCanonical(true);
+        std::vector<Code> canonical = s.find();
+        std::set<std::string> found;
+        for (auto& c: canonical)
+            found.insert(c.canonical().toString());
+        CHECK(found.size() == canonical.size());
+        CHECK(found == classes);
+        CHECK(codeList(s.find(3)) == codeList(canonical));
+    }
+}
+
+// The join of the last levels of generate() only changes how the key
+// tuples are found: without it, with room for fewer levels and in
+// canonical mode, serial, threaded or stepped one node at a time, the
+// list is that of the plain recursion.
+static void joinTests(){
+    for (auto params: {std::make_pair(4, 3), std::make_pair(5, 2), std::make_pair(6, 2)})
+        for (bool canonical: {false, true}){
+            SearchSelfOrthogonal s(params.first, params.second);
+            s.setCanonical(canonical);
+            s.setJoinMemory(0);
+            std::string expected = codeList(s.find());
+            CHECK(!expected.empty());
+            for (size_t memory: {(size_t)1 << 12, JOIN_MEMORY}){
+                s.setJoinMemory(memory);
+                CHECK(codeList(s.find()) == expected);
+                CHECK(codeList(s.find(3)) == expected);
+                SearchCursor cursor;
+                std::vector<Code> stepped;
+                for (size_t calls = 0; !cursor.done && calls < 1000000; ++calls)
+                    s.next(cursor, stepped, SIZE_MAX, 3);
+                CHECK(cursor.done);
+                CHECK(codeList(stepped) == expected);
+            }
+        }
+}
+
+// Shards in index order, or written to files and merged in any order,
+// give the codes of find(), for any shard count.
+static void shardTests(){
+    for (auto params: {std::make_tuple(4, 3, 1), std::make_tuple(6, 2, 1), std::make_tuple(4, 2, 2)}){
+        SearchSelfOrthogonal s(std::get<0>(params), std::get<1>(params), std::get<2>(params));
+        std::string expected = codeList(s.find());
+        for (size_t count: {1, 3, 7, 50}){
+            std::string joined;
+            std::vector<std::string> paths;
+            for (size_t i = 0; i < count; ++i){
+                paths.push_back("shard" + std::to_string(i) + ".tmp");
+                joined += codeList(s.findShard(i, count, 1 + i % 2, paths.back()));
+            }
+            CHECK(joined == expected);
+            std::reverse(paths.begin(), paths.end());
+            CHECK(codeList(s.mergeShards(paths)) == expected);
+            for (auto& path: paths)
+                std::remove(path.c_str());
+        }
+    }
+}
+
+// The visitor and the cursor return find() in pieces: batches of the
+// visitor and any mix of code and node limits of next() add up to the
+// serial list.
+static void streamTests(){
+    SearchSelfOrthogonal s(4, 3);
+    std::vector<Code> all = s.find();
+    std::string expected = codeList(all);
+
+    std::vector<Code> streamed;
+    bool small = true;
+    s.find([&](std::vector<Code>& batch){
+        small = small && !batch.empty() && batch.size() <= 3;
+        streamed.insert(streamed.end(), batch.begin(), batch.end());
+        return true;
+    }, 3);
+    CHECK(small);
+    CHECK(codeList(streamed) == expected);
+
+    size_t batches = 0;
+    streamed.clear();
+    s.find([&](std::vector<Code>& batch){
+        ++batches;
+        streamed.insert(streamed.end(), batch.begin(), batch.end());
+        return false;
+    }, 3);
+    CHECK(batches == 1 && codeList(streamed) == codeList(std::vector<Code>(all.begin(), all.begin() + 3)));
+
+    SearchCursor cursor;
+    streamed.clear();
+    for (size_t calls = 0; !cursor.done && calls < 1000000; ++calls)
+        s.next(cursor, streamed, 1 + calls % 3, calls % 2 == 0 ? 5 : SIZE_MAX);
+    CHECK(cursor.done);
+    CHECK(codeList(streamed) == expected);
+}
+
+// Codes with k > 1 are self-orthogonal and of full rank, every code once,
+// and the threaded search and a cursor give the serial list.
+static void rowsTests(){
+    SearchSelfOrthogonal s(4, 2, 2);
+    std::vector<Code> codes = s.find();
+    CHECK(codes.size() == 4536);
+    bool valid = true;
+    std::vector<std::string> names;
+    for (auto& c: codes){
+        valid = valid && c.k == 2 && c.isSelfOrthogonal() && c.rank() == 2;
+        names.push_back(c.toString());
+    }
+    CHECK(valid);
+    std::sort(names.begin(), names.end());
+    CHECK(std::unique(names.begin(), names.end()) == names.end());
+
+    std::string expected = codeList(codes);
+    CHECK(codeList(s.find(4)) == expected);
+    SearchCursor cursor;
+    std::vector<Code> stepped;
+    for (size_t calls = 0; !cursor.done && calls < 1000000; ++calls)
+        s.next(cursor, stepped, SIZE_MAX, 7);
+    CHECK(cursor.done);
+    CHECK(codeList(stepped) == expected);
+}
+
+// true if decoding `bytes` raises the decoder's runtime_error, not a
+// failed allocation or nothing
+static bool rejected(const std::vector<uint8_t>& bytes){
+    try{
+        deserializeCodes(bytes.data(), bytes.size());
+    } catch (const std::bad_alloc&){
+        return false;
+    } catch (const std::runtime_error&){
+        return true;
+    }
+    return false;
+}
+
+static void serializeTests(){
+    std::vector<Code> codes = {parseCode("11|1u|1v", 3, 1), parseCode("11|01|1||01|11|0", 3, 2)};
+    std::vector<xlong> distances = {6, 2}, read;
+    PackedCodes packed = serializeCodes(codes, &distances);
+    CHECK(codeList(deserializeCodes(packed.data.data(), packed.data.size(), &read)) == codeList(codes));
+    CHECK(read == distances);
+
+    std::vector<uint8_t> cut(packed.data.begin(), packed.data.end() - 2);
+    CHECK(rejected(cut));
+
+    // a zero shift past the end of its series
+    PackedCodes shifted;
+    shifted.add(Code({Series("1u", 1), Series("v1"), Series("1")}, 3, 1));
+    CHECK(!rejected(shifted.data));
+    std::vector<uint8_t> past(shifted.data);
+    // header, n, k, flags, 3 sizes, then the shifts
+    CHECK(past[12] == 1 && past[16] == 1);
+    past[16] = 2;
+    CHECK(rejected(past));
+
+    // 20000 generators of 200000 coefficients each: every size on its
+    // own fits the 60 KB that follow it, all of them do not
+    std::vector<uint8_t> bytes(PackedCodes().data);
+    auto varint = [&](uint64_t v){
+        for (; v >= 0x80; v >>= 7)
+            bytes.push_back((uint8_t)(v | 0x80));
+        bytes.push_back((uint8_t)v);
+    };
+    bytes.insert(bytes.end(), {3, 1, 2});
+    varint(20000);
+    for (size_t i = 0; i < 20000; ++i)
+        varint(200000);
+    bytes.resize(bytes.size() + 1000);
+    CHECK(rejected(bytes));
+
+    std::string stream((const char*)bytes.data(), bytes.size());
+    std::istringstream in(stream);
+    CodeReader reader(in);
+    Code code(0);
+    xlong distance;
+    bool threw = false;
+    try{
+        reader.next(code, distance);
+    } catch (const std::runtime_error&){
+        threw = true;
+    }
+    CHECK(threw);
+}
+
+// What findAsync, progress and cancel do from Python: a search on
+// another thread, watched and stopped from this one.
+static void asyncTests(){
+    SearchSelfOrthogonal s(4, 6);
+    auto search = std::async(std::launch::async, [&](){
+        SearchSelfOrthogonal::Session session(s, 6, false);
+        return s.find(2);
+    });
+    while (s.getProgress().nodes == 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    CHECK(s.getProgress().running);
+
+    // calls side by side share the parameters of the running one
+    bool threw = false;
+    try{
+        SearchSelfOrthogonal::Session other(s, 4, false);
+    } catch (const std::logic_error&){
+        threw = true;
+    }
+    CHECK(threw);
+    threw = false;
+    try{
+        s.setCanonical(true);
+    } catch (const std::logic_error&){
+        threw = true;
+    }
+    CHECK(threw);
+    CHECK(s.getMinDistance() == 6 && !s.getCanonical());
+    {
+        SearchSelfOrthogonal::Session same(s, 6, false);
+    }
+
+    s.cancel();
+    threw = false;
+    try{
+        search.get();
+    } catch (const SearchCancelled&){
+        threw = true;
+    }
+    CHECK(threw);
+    CHECK(!s.getProgress().running);
+
+    // a finished search can change its parameters, and a new call runs
+    // again after a cancellation
+    SearchSelfOrthogonal small(3, 3);
+    {
+        SearchSelfOrthogonal::Session session(small, 0, false);
+        small.cancel();
+    }
+    small.setMinDistance(4);
+    std::string expected = codeList(small.find());
+    SearchSelfOrthogonal::Session session(small, 4, false);
+    CHECK(codeList(small.find()) == expected);
+}
+
+// Every key of a built table is found at its index, its conjugate's
+// index is the one stored, and its bucket holds exactly the series with
+// constant coefficient 1 whose autocorrelation, multiplied out one
+// coefficient at a time, is that key.
+static void rggIndexTests(){
+    for (size_t degree = 1; degree <= 4; ++degree){
+        RggTable t = RggTable::build(degree);
+        CHECK(t.seriesCount() == ((size_t)1 << (2 * degree)));
+        std::set<std::pair<uint64_t, uint64_t>> seen;
+        bool ok = true;
+        for (size_t j = 0; j < t.size(); ++j){
+            ok = ok && t.find(t.key(j)) == j && t.key(t.conj(j)) == t.key(j).conj() && t.bucketSize(j) > 0;
+            ok = ok && (j == 0 || t.key(j - 1) < t.key(j));
+            Series key(t.key(j));
+            key.strip();
+            for (size_t i = 0; i < t.bucketSize(j); ++i){
+                PackedSeries p = t.series(j, i);
+                Series g(p);
+                ok = ok && (p.lo & 1) && !(p.hi & 1) && naiveProduct(g.inverse().conj(), g) == key;
+                seen.insert({p.lo, p.hi});
+            }
+        }
+        CHECK(ok);
+        CHECK(seen.size() == t.seriesCount());
+    }
+}
+
+// true if opening a table of `words` raises "Corrupted Rgg table"
+static bool corruptedTable(const std::vector<uint64_t>& words, const char* path){
+    std::ofstream(path, std::ios::binary | std::ios::trunc).write((const char*)words.data(), words.size() * sizeof(uint64_t));
+    try{
+        RggTable::open(path);
+    } catch (const std::runtime_error& e){
+        return std::string(e.what()) == "Corrupted Rgg table";
+    }
+    return false;
+}
+
+static void rggTests(){
+    const char* path = "rgg.tmp";
+    RggTable built = RggTable::build(3);
+    built.save(path);
+    {
+        RggTable opened = RggTable::open(path);
+        CHECK(opened.size() == built.size() && opened.seriesCount() == built.seriesCount());
+        bool same = true;
+        for (size_t j = 0; j < built.size(); ++j){
+            same = same && opened.key(j) == built.key(j) && opened.conj(j) == built.conj(j)
+                && opened.bucketSize(j) == built.bucketSize(j) && opened.find(built.key(j)) == j;
+            for (size_t i = 0; i < built.bucketSize(j); ++i)
+                same = same && opened.series(j, i) == built.series(j, i);
+        }
+        CHECK(same);
+        CHECK(opened.find(PackedSeries(1, 1, 2, 0)) == opened.size());
+    }
+
+    std::ifstream in(path, std::ios::binary);
+    std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    std::vector<uint64_t> words(bytes.size() / sizeof(uint64_t));
+    std::memcpy(words.data(), bytes.data(), words.size() * sizeof(uint64_t));
+    size_t count = words[3], total = words[4];
+    size_t offsets = 6 + 5 * count, slots = offsets + count + 1 + 2 * total;
+
+    // an offset past the series, offsets going back, a slot pointing past
+    // the keys, a full slot table and a cut file
+    auto bad = words;
+    bad[offsets + 1] = total + 1;
+    CHECK(corruptedTable(bad, path));
+    bad = words;
+    bad[offsets + 1] = bad[offsets + 2] + 1;
+    CHECK(corruptedTable(bad, path));
+    bad = words;
+    for (size_t i = slots; i < bad.size(); ++i)
+        if (bad[i] != 0){
+            bad[i] = (bad[i] >> 32 << 32) | (count + 1);
+            break;
+        }
+    CHECK(corruptedTable(bad, path));
+    bad = words;
+    for (size_t i = slots; i < bad.size(); ++i)
+        bad[i] = (uint64_t)1 << 32 | 1;
+    CHECK(corruptedTable(bad, path));
+    bad.assign(words.begin(), words.end() - 1);
+    CHECK(corruptedTable(bad, path));
+    std::remove(path);
+}
+
+int main(int argc, char** argv){
+    std::string filter;
+    for (int i = 1; i < argc; ++i){
+        std::string a = argv[i];
+        if (a == "--filter" && i + 1 < argc)
+            filter = argv[++i];
+        else {
+            std::cerr << "usage: " << argv[0] << " [--filter substring]" << std::endl;
+            return 2;
+        }
+    }
+
+    struct Test{ const char* name; void (*run)(); };
+    for (auto t: {Test{"series", seriesTests}, Test{"spectrum", spectrumTests}, Test{"orthogonal", orthogonalTests},
+                  Test{"threads", threadsTests}, Test{"stream", streamTests}, Test{"distance", distanceTests},
+                  Test{"canonical", canonicalTests}, Test{"batch", batchTests}, Test{"join", joinTests},
+                  Test{"incremental", incrementalTests}, Test{"bound", boundTests},
+                  Test{"branch", branchTests}, Test{"shard", shardTests},
+                  Test{"checkpoint", checkpointTests}, Test{"rows", rowsTests}, Test{"serialize", serializeTests},
+                  Test{"async", asyncTests}, Test{"rgg", rggTests}, Test{"rgg-index", rggIndexTests}}){
+        if (!filter.empty() && std::string(t.name).find(filter) == std::string::npos)
+            continue;
+        size_t before = failures;
+        t.run();
+        std::cerr << t.name << ": " << (failures == before ? "ok" : "FAILED") << std::endl;
+    }
+    return failures == 0 ? 0 : 1;
+}